@@ -0,0 +1,572 @@
+// Microbenchmarks for the synchronization handoffs used by the ferry simulation.
+//
+// Every handoff is expressed as a counting semaphore with one of several backends
+// (named sem_t, pthread mutex + condvar, sleep polling, spin-then-park, raw futex)
+// and driven through the four patterns of the simulation:
+//   toll       - binary gate, every thread contends for it (toll[i])
+//   square     - counting gate of CAPACITY slots (square[side])
+//   boarding   - ferry admits one vehicle at a time and waits for it to board
+//   disembark  - ferry releases every waiting vehicle at once
+//
+// Build: gcc -O2 -pthread bench.c -o bench
+// Run:   ./bench [--pattern P] [--backend B] [--min-threads N] [--max-threads N]
+//                [--seconds S] [--hold-ns NS] [--poll-us US] [--spin N] [--csv]
+// Results go to stdout (JSON lines, or CSV with --csv); progress goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#endif
+
+#define CAPACITY 20             // Square capacity in the simulation
+#define MAX_THREADS 256
+#define MAX_SAMPLES 4096        // Latency samples kept per thread (reservoir)
+
+typedef enum { B_NAMED_SEM, B_MUTEX_COND, B_POLL, B_SPIN_PARK, B_FUTEX, B_COUNT } Backend;
+typedef enum { P_TOLL, P_SQUARE, P_BOARDING, P_DISEMBARK, P_COUNT } Pattern;
+
+const char *backend_names[B_COUNT] = {"named_sem", "mutex_cond", "poll_sleep", "spin_park", "futex"};
+const char *pattern_names[P_COUNT] = {"toll", "square", "boarding", "disembark"};
+
+// Benchmark settings (set from the command line)
+double run_seconds = 0.5;
+long long hold_ns = 1000;      // Busy time inside the toll/square critical section
+int poll_us = 100;             // Sleep between polls for the polling backend
+int spin_limit = 1000;         // Spins before parking for the spin-then-park backend
+int csv_output = 0;
+
+// A counting semaphore with a pluggable implementation
+typedef struct {
+    Backend backend;
+    sem_t *named;
+    char name[32];
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    atomic_int count;
+    atomic_int waiters;
+} BenchSem;
+
+int sem_serial = 0;
+
+#ifdef __linux__
+long futex_call(atomic_int *addr, int op, int val) {
+    return syscall(SYS_futex, (int *)addr, op, val, NULL, NULL, 0);
+}
+#endif
+
+int backend_available(Backend b) {
+#ifdef __linux__
+    (void)b;
+    return 1;
+#else
+    return b != B_FUTEX;
+#endif
+}
+
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+int bsem_init(BenchSem *s, Backend backend, int value) {
+    memset(s, 0, sizeof(*s));
+    s->backend = backend;
+    atomic_init(&s->count, value);
+    atomic_init(&s->waiters, 0);
+    if (backend == B_NAMED_SEM) {
+        sprintf(s->name, "/bench%d_%d", (int)getpid(), sem_serial++);
+        sem_unlink(s->name);
+        s->named = sem_open(s->name, O_CREAT, 0644, value);
+        if (s->named == SEM_FAILED) {
+            perror("sem_open failed");
+            return -1;
+        }
+    } else {
+        pthread_mutex_init(&s->mutex, NULL);
+        pthread_cond_init(&s->cond, NULL);
+    }
+    return 0;
+}
+
+void bsem_destroy(BenchSem *s) {
+    if (s->backend == B_NAMED_SEM) {
+        sem_close(s->named);
+        sem_unlink(s->name);
+    } else {
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->cond);
+    }
+}
+
+int bsem_try(BenchSem *s) {
+    int c = atomic_load(&s->count);
+    while (c > 0) {
+        if (atomic_compare_exchange_weak(&s->count, &c, c - 1))
+            return 1;
+    }
+    return 0;
+}
+
+void bsem_wait(BenchSem *s) {
+    switch (s->backend) {
+        case B_NAMED_SEM:
+            while (sem_wait(s->named) != 0)
+                ;
+            break;
+        case B_MUTEX_COND:
+            pthread_mutex_lock(&s->mutex);
+            while (atomic_load(&s->count) == 0) {
+                pthread_cond_wait(&s->cond, &s->mutex);
+            }
+            atomic_fetch_sub(&s->count, 1);
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        case B_POLL:
+            while (!bsem_try(s)) {
+                usleep(poll_us);
+            }
+            break;
+        case B_SPIN_PARK:
+            for (int i = 0; i < spin_limit; ++i) {
+                if (bsem_try(s))
+                    return;
+                cpu_relax();
+            }
+            // Waiters is published before the re-check so a poster cannot miss us
+            pthread_mutex_lock(&s->mutex);
+            atomic_fetch_add(&s->waiters, 1);
+            while (!bsem_try(s)) {
+                pthread_cond_wait(&s->cond, &s->mutex);
+            }
+            atomic_fetch_sub(&s->waiters, 1);
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        case B_FUTEX:
+#ifdef __linux__
+            while (!bsem_try(s)) {
+                atomic_fetch_add(&s->waiters, 1);
+                futex_call(&s->count, FUTEX_WAIT_PRIVATE, 0);
+                atomic_fetch_sub(&s->waiters, 1);
+            }
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+void bsem_post_n(BenchSem *s, int n) {
+    switch (s->backend) {
+        case B_NAMED_SEM:
+            for (int i = 0; i < n; ++i) {
+                sem_post(s->named);
+            }
+            break;
+        case B_MUTEX_COND:
+            pthread_mutex_lock(&s->mutex);
+            atomic_fetch_add(&s->count, n);
+            if (n == 1)
+                pthread_cond_signal(&s->cond);
+            else
+                pthread_cond_broadcast(&s->cond);
+            pthread_mutex_unlock(&s->mutex);
+            break;
+        case B_POLL:
+            atomic_fetch_add(&s->count, n);
+            break;
+        case B_SPIN_PARK:
+            atomic_fetch_add(&s->count, n);
+            if (atomic_load(&s->waiters) > 0) {
+                pthread_mutex_lock(&s->mutex);
+                if (n == 1)
+                    pthread_cond_signal(&s->cond);
+                else
+                    pthread_cond_broadcast(&s->cond);
+                pthread_mutex_unlock(&s->mutex);
+            }
+            break;
+        case B_FUTEX:
+#ifdef __linux__
+            atomic_fetch_add(&s->count, n);
+            if (atomic_load(&s->waiters) > 0)
+                futex_call(&s->count, FUTEX_WAKE_PRIVATE, n == 1 ? 1 : INT_MAX);
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+void bsem_post(BenchSem *s) {
+    bsem_post_n(s, 1);
+}
+
+// Per-thread measurements
+typedef struct {
+    int index;
+    long long ops;
+    long long seen;             // Latency samples offered to the reservoir
+    int count;                  // Latency samples stored
+    unsigned int seed;
+    long long samples[MAX_SAMPLES];
+} Worker;
+
+void record_latency(Worker *w, long long ns) {
+    if (w->count < MAX_SAMPLES) {
+        w->samples[w->count++] = ns;
+    } else {
+        long long r = ((long long)rand_r(&w->seed) << 16 ^ rand_r(&w->seed)) % (w->seen + 1);
+        if (r < MAX_SAMPLES)
+            w->samples[r] = ns;
+    }
+    w->seen++;
+}
+
+// Shared state of one benchmark case
+Pattern pattern;
+int thread_count;
+Worker *workers;
+BenchSem gate;                  // toll / square
+BenchSem ferry_sem;             // boarding / disembark: vehicle -> ferry
+BenchSem release_sem[2];        // disembark: ferry -> all vehicles, by round parity
+BenchSem *turn_sem;             // boarding: ferry -> one vehicle
+long long *turn_stamp;
+atomic_llong release_stamp;
+atomic_int start_flag;
+atomic_int stop_flag;
+atomic_int done_flag;           // Ferry has stopped handing off
+
+void wait_for_start() {
+    while (!atomic_load(&start_flag)) {
+        sched_yield();
+    }
+}
+
+void busy_hold() {
+    if (hold_ns <= 0)
+        return;
+    long long until = now_ns() + hold_ns;
+    while (now_ns() < until)
+        cpu_relax();
+}
+
+// toll / square: acquire the gate, hold it briefly, release
+void *gate_worker(void *arg) {
+    Worker *w = (Worker *)arg;
+    wait_for_start();
+    while (!atomic_load(&stop_flag)) {
+        long long t0 = now_ns();
+        bsem_wait(&gate);
+        record_latency(w, now_ns() - t0);
+        busy_hold();
+        bsem_post(&gate);
+        w->ops++;
+    }
+    return NULL;
+}
+
+// boarding: wait for the ferry to grant our turn, then report boarded
+void *boarding_vehicle(void *arg) {
+    Worker *w = (Worker *)arg;
+    wait_for_start();
+    while (1) {
+        bsem_wait(&turn_sem[w->index]);
+        if (atomic_load(&done_flag))
+            break;
+        record_latency(w, now_ns() - turn_stamp[w->index]);
+        w->ops++;
+        bsem_post(&ferry_sem);
+    }
+    return NULL;
+}
+
+void *boarding_ferry(void *arg) {
+    (void)arg;
+    int vehicles = thread_count - 1;
+    wait_for_start();
+    for (int i = 0; !atomic_load(&stop_flag); i = (i + 1) % vehicles) {
+        turn_stamp[i] = now_ns();
+        bsem_post(&turn_sem[i]);
+        bsem_wait(&ferry_sem);
+    }
+    atomic_store(&done_flag, 1);
+    for (int i = 0; i < vehicles; ++i) {
+        bsem_post(&turn_sem[i]);
+    }
+    return NULL;
+}
+
+// disembark: the ferry releases everyone at once and waits until all have left.
+// Rounds alternate between two semaphores, so a vehicle that comes back early
+// waits on the next round's semaphore instead of taking a second token of this one.
+void *disembark_vehicle(void *arg) {
+    Worker *w = (Worker *)arg;
+    wait_for_start();
+    for (int round = 0; ; ++round) {
+        bsem_wait(&release_sem[round & 1]);
+        if (atomic_load(&done_flag))
+            break;
+        record_latency(w, now_ns() - atomic_load(&release_stamp));
+        w->ops++;
+        bsem_post(&ferry_sem);
+    }
+    return NULL;
+}
+
+void *disembark_ferry(void *arg) {
+    (void)arg;
+    int vehicles = thread_count - 1;
+    int round = 0;
+    wait_for_start();
+    for (; !atomic_load(&stop_flag); ++round) {
+        atomic_store(&release_stamp, now_ns());
+        bsem_post_n(&release_sem[round & 1], vehicles);
+        for (int i = 0; i < vehicles; ++i) {
+            bsem_wait(&ferry_sem);
+        }
+    }
+    atomic_store(&done_flag, 1);
+    bsem_post_n(&release_sem[round & 1], vehicles);
+    return NULL;
+}
+
+int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+long long percentile(const long long *sorted, long long n, double q) {
+    if (n == 0)
+        return 0;
+    long long idx = (long long)(q * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+double timeval_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int run_case(Pattern p, Backend b, int threads) {
+    pthread_t tids[MAX_THREADS];
+    int vehicles = threads - 1;
+    int ok = 0;
+
+    pattern = p;
+    thread_count = threads;
+    atomic_store(&start_flag, 0);
+    atomic_store(&stop_flag, 0);
+    atomic_store(&done_flag, 0);
+    workers = calloc(threads, sizeof(Worker));
+    turn_sem = NULL;
+    turn_stamp = NULL;
+    for (int i = 0; i < threads; ++i) {
+        workers[i].index = i;
+        workers[i].seed = (unsigned int)(i * 2654435761u + threads);
+    }
+
+    if (p == P_TOLL || p == P_SQUARE) {
+        ok = bsem_init(&gate, b, p == P_TOLL ? 1 : CAPACITY);
+    } else {
+        ok = bsem_init(&ferry_sem, b, 0);
+        if (ok == 0 && p == P_DISEMBARK)
+            ok = bsem_init(&release_sem[0], b, 0);
+        if (ok == 0 && p == P_DISEMBARK)
+            ok = bsem_init(&release_sem[1], b, 0);
+        if (ok == 0 && p == P_BOARDING) {
+            turn_sem = calloc(vehicles, sizeof(BenchSem));
+            turn_stamp = calloc(vehicles, sizeof(long long));
+            for (int i = 0; i < vehicles && ok == 0; ++i) {
+                ok = bsem_init(&turn_sem[i], b, 0);
+            }
+        }
+    }
+    if (ok != 0)
+        return -1;
+
+    for (int i = 0; i < threads; ++i) {
+        void *(*fn)(void *) = gate_worker;
+        if (p == P_BOARDING)
+            fn = i == vehicles ? boarding_ferry : boarding_vehicle;
+        else if (p == P_DISEMBARK)
+            fn = i == vehicles ? disembark_ferry : disembark_vehicle;
+        if (pthread_create(&tids[i], NULL, fn, &workers[i]) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_SELF, &ru_start);
+    long long t_start = now_ns();
+    atomic_store(&start_flag, 1);
+    usleep((useconds_t)(run_seconds * 1e6));
+    atomic_store(&stop_flag, 1);
+
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    long long elapsed = now_ns() - t_start;
+    getrusage(RUSAGE_SELF, &ru_end);
+
+    // The ferry thread of the handoff patterns only drives, it does not measure
+    long long ops = 0, samples = 0;
+    for (int i = 0; i < threads; ++i) {
+        ops += workers[i].ops;
+        samples += workers[i].count;
+    }
+    long long *all = malloc((samples > 0 ? samples : 1) * sizeof(long long));
+    long long k = 0;
+    for (int i = 0; i < threads; ++i) {
+        memcpy(all + k, workers[i].samples, workers[i].count * sizeof(long long));
+        k += workers[i].count;
+    }
+    qsort(all, samples, sizeof(long long), compare_ll);
+
+    double secs = elapsed / 1e9;
+    long vcsw = ru_end.ru_nvcsw - ru_start.ru_nvcsw;
+    long ivcsw = ru_end.ru_nivcsw - ru_start.ru_nivcsw;
+    double user = timeval_seconds(ru_end.ru_utime) - timeval_seconds(ru_start.ru_utime);
+    double sys = timeval_seconds(ru_end.ru_stime) - timeval_seconds(ru_start.ru_stime);
+
+    if (csv_output) {
+        printf("%s,%s,%d,%lld,%.4f,%.1f,%lld,%lld,%lld,%lld,%lld,%ld,%ld,%.4f,%.4f\n",
+               pattern_names[p], backend_names[b], threads, ops, secs, ops / secs,
+               percentile(all, samples, 0.50), percentile(all, samples, 0.90),
+               percentile(all, samples, 0.99), percentile(all, samples, 0.999),
+               samples > 0 ? all[samples - 1] : 0, vcsw, ivcsw, user, sys);
+    } else {
+        printf("{\"pattern\":\"%s\",\"backend\":\"%s\",\"threads\":%d,\"ops\":%lld,\"seconds\":%.4f,"
+               "\"ops_per_sec\":%.1f,\"wake_ns\":{\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld},"
+               "\"voluntary_csw\":%ld,\"involuntary_csw\":%ld,\"cpu_user_s\":%.4f,\"cpu_sys_s\":%.4f}\n",
+               pattern_names[p], backend_names[b], threads, ops, secs, ops / secs,
+               percentile(all, samples, 0.50), percentile(all, samples, 0.90),
+               percentile(all, samples, 0.99), percentile(all, samples, 0.999),
+               samples > 0 ? all[samples - 1] : 0, vcsw, ivcsw, user, sys);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%-10s %-11s %3d threads: %12.0f ops/s\n",
+            pattern_names[p], backend_names[b], threads, ops / secs);
+
+    free(all);
+    if (p == P_TOLL || p == P_SQUARE) {
+        bsem_destroy(&gate);
+    } else {
+        bsem_destroy(&ferry_sem);
+        if (p == P_DISEMBARK) {
+            bsem_destroy(&release_sem[0]);
+            bsem_destroy(&release_sem[1]);
+        }
+        if (p == P_BOARDING) {
+            for (int i = 0; i < vehicles; ++i) {
+                bsem_destroy(&turn_sem[i]);
+            }
+            free(turn_sem);
+            free(turn_stamp);
+        }
+    }
+    free(workers);
+    return 0;
+}
+
+int find_name(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  --pattern P        toll, square, boarding, disembark (default all)\n"
+            "  --backend B        named_sem, mutex_cond, poll_sleep, spin_park, futex (default all)\n"
+            "  --min-threads N    Smallest thread count, doubled up to the max (default 2)\n"
+            "  --max-threads N    Largest thread count, at most %d (default %d)\n"
+            "  --seconds S        Run time of each case (default %.1f)\n"
+            "  --hold-ns NS       Busy time inside the toll/square gate (default %lld)\n"
+            "  --poll-us US       Sleep between polls for poll_sleep (default %d)\n"
+            "  --spin N           Spins before parking for spin_park (default %d)\n"
+            "  --csv              Emit CSV instead of JSON lines\n",
+            prog, MAX_THREADS, MAX_THREADS, run_seconds, hold_ns, poll_us, spin_limit);
+}
+
+int main(int argc, char *argv[]) {
+    int only_pattern = -1, only_backend = -1;
+    int min_threads = 2, max_threads = MAX_THREADS;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--csv") == 0) {
+            csv_output = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char *value = argv[++i];
+        if (strcmp(opt, "--pattern") == 0) only_pattern = find_name(value, pattern_names, P_COUNT);
+        else if (strcmp(opt, "--backend") == 0) only_backend = find_name(value, backend_names, B_COUNT);
+        else if (strcmp(opt, "--min-threads") == 0) min_threads = atoi(value);
+        else if (strcmp(opt, "--max-threads") == 0) max_threads = atoi(value);
+        else if (strcmp(opt, "--seconds") == 0) run_seconds = atof(value);
+        else if (strcmp(opt, "--hold-ns") == 0) hold_ns = atoll(value);
+        else if (strcmp(opt, "--poll-us") == 0) poll_us = atoi(value);
+        else if (strcmp(opt, "--spin") == 0) spin_limit = atoi(value);
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if ((strcmp(opt, "--pattern") == 0 && only_pattern < 0) ||
+            (strcmp(opt, "--backend") == 0 && only_backend < 0)) {
+            fprintf(stderr, "Unknown %s: %s\n", opt + 2, value);
+            return EXIT_FAILURE;
+        }
+    }
+    if (min_threads < 2 || max_threads > MAX_THREADS || min_threads > max_threads || run_seconds <= 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (csv_output)
+        printf("pattern,backend,threads,ops,seconds,ops_per_sec,wake_p50_ns,wake_p90_ns,"
+               "wake_p99_ns,wake_p999_ns,wake_max_ns,voluntary_csw,involuntary_csw,cpu_user_s,cpu_sys_s\n");
+
+    for (int p = 0; p < P_COUNT; ++p) {
+        if (only_pattern >= 0 && p != only_pattern)
+            continue;
+        for (int b = 0; b < B_COUNT; ++b) {
+            if ((only_backend >= 0 && b != only_backend) || !backend_available(b))
+                continue;
+            for (int n = min_threads; n <= max_threads; n *= 2) {
+                if (run_case(p, b, n) != 0) {
+                    fprintf(stderr, "Skipping %s/%s: backend setup failed\n",
+                            pattern_names[p], backend_names[b]);
+                    break;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -127,12 +127,13 @@ void *vehicle_thread(void *arg) {
 
 void *ferry_thread(void *arg) {
     while (1) {
-        pthread_mutex_lock(&ferry_mutex);
-
+        pthread_mutex_lock(&start_mutex);
         while (!start_signal_given)
             pthread_cond_wait(&start_cond, &start_mutex);
         pthread_mutex_unlock(&start_mutex);
 
+        pthread_mutex_lock(&ferry_mutex);
+
         while (ferry_load < CAPACITY &&
                (vehicles_waiting[ferry_side] + pending_on_side[ferry_side]) > 0) {
             pthread_cond_wait(&ferry_full, &ferry_mutex);
@@ -1,3 +1,4 @@
+// Build: gcc -O2 -pthread new2.c -o new2 -lm (Linux needs -lm for log, sin and ceil)
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -6,6 +7,9 @@
 #include <unistd.h>
 #include <time.h> // For clock_gettime
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
 
 #define TOTAL_CARS 12
 #define TOTAL_MINIBUSES 10
@@ -13,7 +17,58 @@
 #define TOTAL_VEHICLES (TOTAL_CARS + TOTAL_MINIBUSES + TOTAL_TRUCKS)
 #define CAPACITY 20
 
+// Toll plaza
+#define MAX_LANES 4             // Toll lanes per side
+
+// Dock
+#define MAX_RAMPS 4             // Parallel loading ramps
+#define DOCKING_MS 1000         // Mooring before the ramps come down
+
+// Open-system mode limits
+#define POOL_SIZE 512           // Maximum number of vehicles in the system at once
+#define WINDOW_BUCKETS 60       // Number of slots in the sliding statistics window
+#define LATENCY_BINS 80         // Log-linear latency histogram bins (up to ~35 minutes)
+
+// Advance reservations
+#define BOOKING_WINDOW 1024     // Departures indexed ahead of the current one (power of two)
+#define BOOKING_UNIT_BITS 24    // Low bits of a slot word hold the booked units
+
+// Post-run analytics
+#define MAX_ANALYTICS_THREADS 16
+#define ANALYTICS_MIN_CHUNK 65536   // Rows below which extra threads do not pay off
+
+// Stall watchdog
+#define FERRY_AGENT 0           // Heartbeat slots: the ferry, the arrival generator, then vehicles
+#define ARRIVAL_AGENT 1
+#define VEHICLE_AGENT_BASE 2
+#define HEARTBEAT_SLOTS (VEHICLE_AGENT_BASE + POOL_SIZE)
+#define STALL_EXIT_CODE 3
+
+// Time-series sampler
+#define SAMPLE_ROWS 4096        // Rows per columnar block (two blocks are preallocated)
+#define SAMPLE_COLUMNS 19       // Integer columns besides the timestamp
+#define SAMPLE_MAGIC "FSMP2"
+
+// Relaxed atomic read of a counter owned by ferry_mutex; the sampler never takes the lock
+#define PEEK(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define BUMP(x, d) __atomic_fetch_add(&(x), (d), __ATOMIC_RELAXED)
+
+// Limits spelled out in error messages
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
 typedef enum { CAR = 1, MINIBUS = 2, TRUCK = 3 } VehicleType;
+typedef enum { LANE_MIXED, LANE_TAG, LANE_HEAVY } LaneKind;
+typedef enum { RUN_SIMULATION, RUN_ANALYTICS_BENCH, RUN_BOOKING_BENCH, RUN_DUMP_SAMPLES } RunMode;
+
+// Where an agent last reported itself; every change counts as progress
+typedef enum {
+    STAGE_NONE, STAGE_STARTING, STAGE_TOLL_QUEUE, STAGE_TOLL_SERVICE, STAGE_SQUARE_QUEUE,
+    STAGE_SETTLING, STAGE_AWAITING_FERRY, STAGE_LOADING, STAGE_ON_BOARD, STAGE_UNLOADING,
+    STAGE_RESTING, STAGE_LEAVING,
+    STAGE_FERRY_PARKED, STAGE_FERRY_BOARDING, STAGE_FERRY_CLOSING, STAGE_FERRY_SAILING,
+    STAGE_FERRY_DOCKING, STAGE_FERRY_UNLOADING, STAGE_ARRIVALS, STAGE_DONE
+} AgentStage;
 
 typedef struct {
     int id;
@@ -24,12 +79,35 @@ typedef struct {
     struct timespec start_time;    // Time vehicle entered the system
     struct timespec end_time;      // Time vehicle exited the system
     long long total_wait_time;     // Total waiting time for the vehicle (nanoseconds)
+    int has_tag;                   // Pre-paid electronic tag
+    long long booking;             // Reserved departure, -1 for walk-up
 } Vehicle;
 
 Vehicle vehicles[TOTAL_VEHICLES];
 
-sem_t *toll[4];
+sem_t *toll[2 * MAX_LANES];       // Index: side * MAX_LANES + lane
 sem_t *square[2];
+sem_t *ramp;
+
+// Toll plaza layout, identical on both sides (set from the command line)
+LaneKind lanes[MAX_LANES] = {LANE_MIXED, LANE_MIXED};
+int lane_count = 2;
+double tag_share = 0.0;           // Fraction of vehicles with a pre-paid tag
+
+// Mean toll service time in milliseconds, by payment (cash, tag) and vehicle type
+const int toll_service_ms[2][4] = {
+    {0, 3000, 4000, 6000},
+    {0, 300, 500, 1500}
+};
+
+// Ramp transfer time in milliseconds by vehicle type
+int ramp_count = 2;
+const int load_ms[4] = {0, 2000, 3000, 5000};
+const int unload_ms[4] = {0, 1500, 2500, 4000};
+
+// Per-lane counters, updated atomically
+long long lane_busy_ns[2 * MAX_LANES];
+long long lane_served[2 * MAX_LANES];
 
 pthread_mutex_t ferry_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t ferry_full = PTHREAD_COND_INITIALIZER;
@@ -43,14 +121,166 @@ int ferry_side;
 int vehicles_on_ferry[CAPACITY];
 int vehicle_count = 0;
 
+// Dock state, guarded by ferry_mutex
+pthread_cond_t dock_cond = PTHREAD_COND_INITIALIZER;
+int ferry_docked = 1;             // Ramps are down on ferry_side
+int ferry_closing = 0;            // Departure decided, no new boarding
+int ferry_unloading = 0;          // Vehicles are leaving in last-on, first-off order
+int initial_ferry_side;           // Departure d leaves from initial_ferry_side ^ (d & 1)
+int load_next = 0;                // Manifest position allowed onto a ramp next
+int unload_next = 0;
+int loaded_count = 0;
+int unloaded_count = 0;
+long long load_first_start_ns = 0;
+long long load_last_end_ns = 0;
+
+// Reservations (set from the command line)
+double reserve_share = 0.0;       // Fraction of trips booked in advance
+double reserve_cap = 0.5;         // Fraction of capacity open to bookings
+double overbook = 0.1;            // Extra bookings accepted beyond that share
+int booking_limit;                // Bookable units per departure
+
+// One word per departure in the window: departure number above, booked units below.
+// Reserve and cancel are a single CAS, so vehicle threads never take ferry_mutex for them.
+unsigned long long booking_slots[BOOKING_WINDOW];
+
+// Booked vehicles parked in the reserved lane, by departure slot and type (ferry_mutex)
+int lane_ready[BOOKING_WINDOW][4];
+int reserved_boarded_units = 0;   // Booked units already aboard the docked ferry
+
+// Walk-up versus reserved comparison, updated atomically
+long long bookings_made = 0, bookings_rebooked = 0;
+long long board_wait_ns[2], board_wait_count[2];    // [0] walk-up, [1] reserved
+long long square_slot_ns = 0;     // Holding-area slot time summed over vehicles
+
+// Dwell time totals over all departures
+long long dwell_total_ns = 0, dwell_unload_ns = 0, dwell_load_ns = 0, dwell_wait_ns = 0;
+
 int vehicles_waiting[2] = {0, 0};       // Vehicles in waiting area
+int waiting_by_type[2][4];              // Waiting vehicles per side and type
 int pending_on_side[2] = {0, 0};        // Vehicles before passing the toll gate
 int vehicles_remaining = TOTAL_VEHICLES * 2; // Initially, each vehicle makes 2 trips (round trip)
+int total_ferry_crossings = 0;
 
 // System-wide time measurements
 struct timespec simulation_start_time;
 struct timespec simulation_end_time;
 
+// Open-system configuration (set from the command line)
+typedef struct {
+    int enabled;
+    double arrival_rate;      // Mean arrivals per second
+    double profile_amplitude; // Relative swing of the arrival rate (0..1)
+    double profile_period;    // Length of one arrival rate cycle (seconds)
+    double duration;          // Length of the arrival phase (0 = until Ctrl+C)
+    double warmup;            // Vehicles arriving before this are not counted (seconds)
+    double window;            // Length of the sliding statistics window (seconds)
+    double report_interval;   // Seconds between window reports
+} OpenConfig;
+
+OpenConfig open_cfg = {0, 0.5, 0.0, 600.0, 0.0, 60.0, 60.0, 10.0};
+int departure_timeout = 0;    // Seconds the ferry waits at the dock (0 = until full)
+RunMode run_mode = RUN_SIMULATION;
+const char *run_mode_arg = NULL;  // Row/operation count or sample file for the other modes
+
+volatile sig_atomic_t stop_requested = 0;
+int arrivals_closed = 0;      // No more arrivals will be generated (open mode)
+int vehicles_in_system = 0;   // Vehicles that have not left the system yet
+int next_vehicle_id = 0;
+
+// Vehicle memory pool for open mode
+Vehicle vehicle_pool[POOL_SIZE];
+int pool_free[POOL_SIZE];
+int pool_top = 0;
+pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Sliding-window statistics (bounded memory, one slot per bucket interval)
+typedef struct {
+    long long epoch;          // Bucket interval this slot currently holds
+    long long completed;
+    long long latency_sum_ns;
+    long long wait_sum_ns;
+    unsigned int latency_hist[LATENCY_BINS];
+} WindowBucket;
+
+WindowBucket window_buckets[WINDOW_BUCKETS];
+long long bucket_width_ns;
+long long stats_completed = 0;        // Completed after warm-up
+long long stats_warmup_discarded = 0; // Completed, but arrived during warm-up
+long long stats_rejected = 0;         // Arrivals dropped because the pool was full
+long long stats_latency_sum_ns = 0;
+unsigned long long stats_latency_hist[LATENCY_BINS];
+// Per-type aggregates after warm-up, indexed by VehicleType; fixed size however long the run
+long long stats_type_count[4];
+long long stats_type_system_sum_ns[4];
+long long stats_type_wait_sum_ns[4];
+long long stats_type_system_max_ns[4];
+unsigned long long stats_type_hist[4][LATENCY_BINS];
+pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+int reporter_done = 0;
+
+// Per-vehicle results as contiguous int64 columns, one row per completed vehicle
+typedef struct {
+    long long rows;
+    long long capacity;
+    long long *id;
+    long long *type;          // VehicleType
+    long long *system_ns;     // Time in system
+    long long *wait_ns;       // Time spent waiting in queues
+} ResultTable;
+
+ResultTable results;
+int analytics_threads = 1;
+const char *results_path = NULL;  // Full per-vehicle table, written as CSV
+FILE *results_file = NULL;        // Open mode streams rows here (stats_mutex) instead of keeping them
+
+// Queue lengths maintained without ferry_mutex (atomic increments only)
+int toll_queue[2 * MAX_LANES];        // Vehicles waiting at or passing each lane
+int square_occupancy[2] = {0, 0};     // Vehicles holding a holding-area slot, not yet boarded
+
+// Progress heartbeats, written without locks and read by the watchdog
+typedef struct {
+    int stage;                // AgentStage
+    int vehicle_id;           // -1 for the ferry and the arrival generator
+    long long since_ns;       // When the agent entered its stage
+} Heartbeat;
+
+Heartbeat heartbeats[HEARTBEAT_SLOTS];
+long long progress_count = 0;          // Stage changes over all agents
+long long ferry_progress_ns = 0;       // Last stage change by the ferry or on its ramps
+int stall_timeout = 60;                // Seconds without progress before a dump (0 = off)
+int stall_abort = 0;                   // Exit with STALL_EXIT_CODE after the dump
+int stalls_detected = 0;
+int watchdog_done = 0;
+__thread int self_agent = -2;          // Heartbeat slot of the calling thread, -2 for helpers
+int ferry_mutex_owner = -1;            // Agent holding ferry_mutex, -1 when free
+
+// Columnar sample blocks: the sampler fills one while the writer encodes the other
+typedef struct {
+    int rows;
+    long long t_ns[SAMPLE_ROWS];
+    int col[SAMPLE_COLUMNS][SAMPLE_ROWS];
+} SampleBlock;
+
+const char *sample_column_names[SAMPLE_COLUMNS] = {
+    "pending_0", "pending_1", "waiting_0", "waiting_1",
+    "gate_0", "gate_1", "gate_2", "gate_3", "gate_4", "gate_5", "gate_6", "gate_7",
+    "square_0", "square_1",
+    "ferry_load", "ferry_side", "on_ferry", "in_system", "crossings"
+};
+
+SampleBlock sample_blocks[2];
+int sample_active = 0;                // Block the sampler is filling
+int sample_pending = -1;              // Block handed to the writer, -1 if none
+long long samples_dropped = 0;        // Blocks lost because the writer fell behind
+int sample_interval_ms = 100;
+const char *sample_path = NULL;
+FILE *sample_file = NULL;
+pthread_t sample_threads[2];          // Sampler and writer, kept for the watchdog's abort path
+int sampler_done = 0;
+pthread_mutex_t sample_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sample_cond = PTHREAD_COND_INITIALIZER;
+
 const char* vehicle_type_str(VehicleType type) {
     switch (type) {
         case CAR: return "Car";
@@ -60,111 +290,649 @@ const char* vehicle_type_str(VehicleType type) {
     }
 }
 
+const char *lane_kind_str(LaneKind kind) {
+    switch (kind) {
+        case LANE_MIXED: return "mixed";
+        case LANE_TAG: return "tag";
+        case LANE_HEAVY: return "heavy";
+        default: return "unknown";
+    }
+}
+
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void heartbeat(int agent, int vehicle_id, AgentStage stage) {
+    Heartbeat *hb = &heartbeats[agent];
+    long long now = now_ns();
+    int old = __atomic_load_n(&hb->stage, __ATOMIC_RELAXED);
+    __atomic_store_n(&hb->vehicle_id, vehicle_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&hb->since_ns, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&hb->stage, stage, __ATOMIC_RELEASE);
+    BUMP(progress_count, 1);
+    if (agent == FERRY_AGENT || (stage >= STAGE_LOADING && stage <= STAGE_UNLOADING) ||
+        (old >= STAGE_LOADING && old <= STAGE_UNLOADING))
+        __atomic_store_n(&ferry_progress_ns, now, __ATOMIC_RELAXED);
+}
+
+// Closed-mode vehicles live in vehicles[], open-mode ones in the pool
+int vehicle_agent(const Vehicle *v) {
+    if (v >= vehicle_pool && v < vehicle_pool + POOL_SIZE)
+        return VEHICLE_AGENT_BASE + (int)(v - vehicle_pool);
+    return VEHICLE_AGENT_BASE + (int)(v - vehicles);
+}
+
+void vehicle_beat(const Vehicle *v, AgentStage stage) {
+    heartbeat(vehicle_agent(v), v->id, stage);
+}
+
+// ferry_mutex wrappers that record the owner for the watchdog dump
+void ferry_lock() {
+    pthread_mutex_lock(&ferry_mutex);
+    __atomic_store_n(&ferry_mutex_owner, self_agent, __ATOMIC_RELAXED);
+}
+
+void ferry_unlock() {
+    __atomic_store_n(&ferry_mutex_owner, -1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ferry_mutex);
+}
+
+void ferry_wait(pthread_cond_t *cond) {
+    __atomic_store_n(&ferry_mutex_owner, -1, __ATOMIC_RELAXED);
+    pthread_cond_wait(cond, &ferry_mutex);
+    __atomic_store_n(&ferry_mutex_owner, self_agent, __ATOMIC_RELAXED);
+}
+
+int ferry_timedwait(pthread_cond_t *cond, const struct timespec *deadline) {
+    __atomic_store_n(&ferry_mutex_owner, -1, __ATOMIC_RELAXED);
+    int rc = pthread_cond_timedwait(cond, &ferry_mutex, deadline);
+    __atomic_store_n(&ferry_mutex_owner, self_agent, __ATOMIC_RELAXED);
+    return rc;
+}
+
+long long timespec_to_ns(struct timespec ts) {
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long since_start_ns(long long t) {
+    return t - timespec_to_ns(simulation_start_time);
+}
+
+void sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+}
+
+// Sleeps until the monotonic clock reaches t. macOS has no clock_nanosleep, so this
+// recomputes a relative nanosleep after every interruption. An interruptible sleep
+// wakes at least every 100 ms to notice Ctrl+C, which may be delivered to another thread.
+void sleep_until_ns(long long t, int interruptible) {
+    long long left;
+    while ((left = t - now_ns()) > 0 && !(interruptible && stop_requested)) {
+        if (interruptible && left > 100000000LL)
+            left = 100000000LL;
+        struct timespec ts = {left / 1000000000LL, left % 1000000000LL};
+        nanosleep(&ts, NULL);
+    }
+}
+
+int lane_accepts(LaneKind kind, const Vehicle *v) {
+    switch (kind) {
+        case LANE_TAG: return v->has_tag;
+        case LANE_HEAVY: return v->type != CAR;
+        default: return 1;
+    }
+}
+
+// Picks the eligible lane with the shortest queue, breaking ties at random
+int choose_lane(const Vehicle *v) {
+    int best = -1, best_queue = 0, ties = 0;
+    for (int lane = 0; lane < lane_count; ++lane) {
+        if (!lane_accepts(lanes[lane], v))
+            continue;
+        int queue = PEEK(toll_queue[v->current_side * MAX_LANES + lane]);
+        if (best < 0 || queue < best_queue) {
+            best = lane;
+            best_queue = queue;
+            ties = 1;
+        } else if (queue == best_queue && rand() % ++ties == 0) {
+            best = lane;
+        }
+    }
+    return best;
+}
+
+// Service time varies +/-25% around the class mean
+long toll_service_time_ms(const Vehicle *v) {
+    int mean = toll_service_ms[v->has_tag][v->type];
+    return (long)(mean * (0.75 + 0.5 * rand() / (double)RAND_MAX));
+}
+
+int departure_side(long long d) {
+    return initial_ferry_side ^ (int)(d & 1);
+}
+
+// Books units on departure d; fails if the departure is full or outside the window
+int booking_reserve(long long d, int units) {
+    unsigned long long *slot = &booking_slots[d & (BOOKING_WINDOW - 1)];
+    unsigned long long old = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    while (1) {
+        long long tag = (long long)(old >> BOOKING_UNIT_BITS);
+        int booked = (int)(old & ((1ULL << BOOKING_UNIT_BITS) - 1));
+        if (tag > d)
+            return 0;       // Slot already holds a later departure
+        if (tag < d)
+            booked = 0;     // Stale slot from an earlier lap of the window
+        if (booked + units > booking_limit)
+            return 0;
+        unsigned long long next = ((unsigned long long)d << BOOKING_UNIT_BITS) | (unsigned long long)(booked + units);
+        if (__atomic_compare_exchange_n(slot, &old, next, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 1;
+    }
+}
+
+void booking_cancel(long long d, int units) {
+    unsigned long long *slot = &booking_slots[d & (BOOKING_WINDOW - 1)];
+    unsigned long long old = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    while ((long long)(old >> BOOKING_UNIT_BITS) == d && (old & ((1ULL << BOOKING_UNIT_BITS) - 1)) >= (unsigned long long)units) {
+        if (__atomic_compare_exchange_n(slot, &old, old - units, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return;
+    }
+}
+
+int booking_units(long long d) {
+    unsigned long long word = __atomic_load_n(&booking_slots[d & (BOOKING_WINDOW - 1)], __ATOMIC_ACQUIRE);
+    if ((long long)(word >> BOOKING_UNIT_BITS) != d)
+        return 0;
+    return (int)(word & ((1ULL << BOOKING_UNIT_BITS) - 1));
+}
+
+// Reserves the first departure from `side` at or after `from` with room for `units`
+long long booking_find(int side, long long from, int units) {
+    long long d = departure_side(from) == side ? from : from + 1;
+    for (; d < from + BOOKING_WINDOW; d += 2) {
+        if (booking_reserve(d, units))
+            return d;
+    }
+    return -1;
+}
+
+// Called with ferry_mutex held: booked units of the docked departure not yet aboard
+int outstanding_reserved_units() {
+    int units = booking_units(total_ferry_crossings) - reserved_boarded_units;
+    return units > 0 ? units : 0;
+}
+
+// Called with ferry_mutex held
+int reserved_vehicle_fits() {
+    int *ready = lane_ready[total_ferry_crossings & (BOOKING_WINDOW - 1)];
+    for (int type = CAR; type <= TRUCK; ++type) {
+        if (ready[type] > 0 && ferry_load + type <= CAPACITY)
+            return 1;
+    }
+    return 0;
+}
+
+// Waits for this vehicle's turn in the ramp order, takes a ramp, then lets the
+// next vehicle queue for one; ordering is kept because the ramp is taken in turn
+void ramp_transfer(int pos, int *next, int step, long ms) {
+    ferry_lock();
+    while (*next != pos) {
+        ferry_wait(&dock_cond);
+    }
+    ferry_unlock();
+
+    sem_wait(ramp);
+    ferry_lock();
+    *next += step;
+    pthread_cond_broadcast(&dock_cond);
+    ferry_unlock();
+
+    sleep_ms(ms);
+    sem_post(ramp);
+}
+
+// Called with ferry_mutex held; vehicles that cannot fit must not hold the ferry.
+// Walk-ups only get the space not held back for booked vehicles.
+int waiting_vehicle_fits() {
+    int held = outstanding_reserved_units();
+    for (int type = CAR; type <= TRUCK; ++type) {
+        if (waiting_by_type[ferry_side][type] > 0 && ferry_load + type + held <= CAPACITY)
+            return 1;
+    }
+    return 0;
+}
+
+// Called with ferry_mutex held
+int simulation_finished() {
+    if (open_cfg.enabled)
+        return arrivals_closed && vehicles_in_system == 0;
+    return vehicles_remaining == 0 && ferry_load == 0 &&
+           vehicles_waiting[0] == 0 && vehicles_waiting[1] == 0 &&
+           pending_on_side[0] == 0 && pending_on_side[1] == 0;
+}
+
+Vehicle *pool_acquire() {
+    Vehicle *v = NULL;
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_top > 0)
+        v = &vehicle_pool[pool_free[--pool_top]];
+    pthread_mutex_unlock(&pool_mutex);
+    return v;
+}
+
+void pool_release(Vehicle *v) {
+    pthread_mutex_lock(&pool_mutex);
+    pool_free[pool_top++] = (int)(v - vehicle_pool);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void pool_init() {
+    for (int i = 0; i < POOL_SIZE; ++i) {
+        pool_free[i] = POOL_SIZE - 1 - i;
+    }
+    pool_top = POOL_SIZE;
+}
+
+// Log-linear histogram: exact below 8 ms, then 4 bins per power of two
+int latency_bin(long long ns) {
+    long long ms = ns / 1000000;
+    if (ms < 8)
+        return (int)(ms < 0 ? 0 : ms);
+    int e = 63 - __builtin_clzll((unsigned long long)ms);
+    int bin = 8 + (e - 3) * 4 + (int)((ms >> (e - 2)) & 3);
+    return bin < LATENCY_BINS ? bin : LATENCY_BINS - 1;
+}
+
+// Upper bound of a histogram bin in milliseconds
+double latency_bin_upper_ms(int bin) {
+    if (bin < 8)
+        return bin + 1;
+    int e = (bin - 8) / 4 + 3;
+    int sub = (bin - 8) % 4;
+    return (double)((4LL + sub + 1) << (e - 2));
+}
+
+double hist_percentile_ms(const unsigned long long *hist, long long total, double q) {
+    if (total == 0)
+        return 0.0;
+    long long target = (long long)ceil(q * total);
+    long long seen = 0;
+    for (int i = 0; i < LATENCY_BINS; ++i) {
+        seen += hist[i];
+        if (seen >= target)
+            return latency_bin_upper_ms(i);
+    }
+    return latency_bin_upper_ms(LATENCY_BINS - 1);
+}
+
+int results_reserve(ResultTable *t, long long rows) {
+    if (rows <= t->capacity)
+        return 0;
+    long long capacity = t->capacity > 0 ? t->capacity : 1024;
+    while (capacity < rows)
+        capacity *= 2;
+    long long **cols[4] = {&t->id, &t->type, &t->system_ns, &t->wait_ns};
+    for (int c = 0; c < 4; ++c) {
+        long long *grown = realloc(*cols[c], sizeof(long long) * capacity);
+        if (grown == NULL)
+            return -1;
+        *cols[c] = grown;
+    }
+    t->capacity = capacity;
+    return 0;
+}
+
+// Closed mode fills the table after the run; fails if the table cannot grow
+int results_append(ResultTable *t, const Vehicle *v, long long system_ns) {
+    if (results_reserve(t, t->rows + 1) != 0)
+        return -1;
+    long long r = t->rows++;
+    t->id[r] = v->id;
+    t->type[r] = v->type;
+    t->system_ns[r] = system_ns;
+    t->wait_ns[r] = v->total_wait_time;
+    return 0;
+}
+
+FILE *results_open(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("fopen results");
+        return NULL;
+    }
+    static char buf[1 << 16];
+    setvbuf(f, buf, _IOFBF, sizeof(buf));
+    fprintf(f, "id,type,system_ns,wait_ns\n");
+    return f;
+}
+
+void results_write_row(FILE *f, long long id, long long type, long long system_ns, long long wait_ns) {
+    fprintf(f, "%lld,%s,%lld,%lld\n", id, vehicle_type_str((VehicleType)type), system_ns, wait_ns);
+}
+
+// Records a vehicle that left the system (open mode)
+void stats_record(Vehicle *v) {
+    long long arrival = timespec_to_ns(v->start_time);
+    long long departure = timespec_to_ns(v->end_time);
+    long long latency = departure - arrival;
+    int bin = latency_bin(latency);
+
+    pthread_mutex_lock(&stats_mutex);
+    if (since_start_ns(arrival) < (long long)(open_cfg.warmup * 1e9)) {
+        stats_warmup_discarded++;
+        pthread_mutex_unlock(&stats_mutex);
+        return;
+    }
+    stats_completed++;
+    stats_latency_sum_ns += latency;
+    stats_latency_hist[bin]++;
+    stats_type_count[v->type]++;
+    stats_type_system_sum_ns[v->type] += latency;
+    stats_type_wait_sum_ns[v->type] += v->total_wait_time;
+    if (latency > stats_type_system_max_ns[v->type])
+        stats_type_system_max_ns[v->type] = latency;
+    stats_type_hist[v->type][bin]++;
+    if (results_file != NULL)
+        results_write_row(results_file, v->id, v->type, latency, v->total_wait_time);
+
+    long long epoch = since_start_ns(departure) / bucket_width_ns;
+    WindowBucket *b = &window_buckets[epoch % WINDOW_BUCKETS];
+    if (b->epoch != epoch) {
+        memset(b, 0, sizeof(*b));
+        b->epoch = epoch;
+    }
+    b->completed++;
+    b->latency_sum_ns += latency;
+    b->wait_sum_ns += v->total_wait_time;
+    b->latency_hist[bin]++;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_report_window() {
+    unsigned long long hist[LATENCY_BINS] = {0};
+    long long completed = 0, latency_sum = 0, wait_sum = 0;
+    long long now = since_start_ns(now_ns());
+    long long epoch = now / bucket_width_ns;
+    long long warmup_ns = (long long)(open_cfg.warmup * 1e9);
+
+    if (now < warmup_ns) {
+        printf("\n### [t=%.0fs] Warm-up in progress (%.0fs left) ###\n\n",
+               now / 1e9, (warmup_ns - now) / 1e9);
+        return;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        WindowBucket *b = &window_buckets[i];
+        if (b->completed == 0 || b->epoch <= epoch - WINDOW_BUCKETS || b->epoch > epoch)
+            continue;
+        completed += b->completed;
+        latency_sum += b->latency_sum_ns;
+        wait_sum += b->wait_sum_ns;
+        for (int j = 0; j < LATENCY_BINS; ++j) {
+            hist[j] += b->latency_hist[j];
+        }
+    }
+    long long rejected = stats_rejected;
+    pthread_mutex_unlock(&stats_mutex);
+
+    // The window never reaches back into the warm-up period
+    double span = open_cfg.window;
+    if ((now - warmup_ns) / 1e9 < span)
+        span = (now - warmup_ns) / 1e9;
+
+    printf("\n### [t=%.0fs] Last %.0fs: %lld vehicles, %.3f veh/s", now / 1e9, span, completed,
+           span > 0 ? completed / span : 0.0);
+    if (completed > 0) {
+        printf(", avg system %.2fs, avg wait %.2fs, p50 %.1fs, p95 %.1fs, p99 %.1fs",
+               latency_sum / 1e9 / completed, wait_sum / 1e9 / completed,
+               hist_percentile_ms(hist, completed, 0.50) / 1000.0,
+               hist_percentile_ms(hist, completed, 0.95) / 1000.0,
+               hist_percentile_ms(hist, completed, 0.99) / 1000.0);
+    }
+    printf(", rejected %lld ###\n\n", rejected);
+}
+
 void *vehicle_thread(void *arg) {
     Vehicle *v = (Vehicle *)arg;
     struct timespec wait_start, wait_end; // For general waiting time measurement
 
-    // Record the time the vehicle enters the system
-    clock_gettime(CLOCK_MONOTONIC, &v->start_time);
+    // Record the time the vehicle enters the system (open mode: set on arrival)
+    if (!open_cfg.enabled)
+        clock_gettime(CLOCK_MONOTONIC, &v->start_time);
+    int trips = open_cfg.enabled ? 1 : 2;
 
+    self_agent = vehicle_agent(v);
+    vehicle_beat(v, STAGE_STARTING);
     pthread_mutex_lock(&start_mutex);
     while (!start_signal_given) {
         pthread_cond_wait(&start_cond, &start_mutex);
     }
     pthread_mutex_unlock(&start_mutex);
 
-    for (int trip = 0; trip < 2; trip++) {
-        pthread_mutex_lock(&ferry_mutex);
+    for (int trip = 0; trip < trips; trip++) {
+        ferry_lock();
         pending_on_side[v->current_side]++;
-        pthread_mutex_unlock(&ferry_mutex);
+        ferry_unlock();
 
-        int local_gate = rand() % 2;
-        int toll_index = v->current_side * 2 + local_gate;
+        // Booked trips reserve the first departure they can still reach
+        v->booking = -1;
+        if (reserve_share > 0 && rand() < reserve_share * RAND_MAX) {
+            v->booking = booking_find(v->current_side, PEEK(total_ferry_crossings) + 1, v->type);
+            if (v->booking >= 0) {
+                BUMP(bookings_made, 1);
+                printf("[Vehicle %d - %s] Reserved departure %lld from Side %d\n",
+                       v->id, vehicle_type_str(v->type), v->booking, v->current_side);
+            }
+        }
 
-        printf("[Vehicle %d - %s] Waiting for gate %d on Side %d...\n",
-               v->id, vehicle_type_str(v->type), local_gate, v->current_side);
+        int local_gate = choose_lane(v);
+        int toll_index = v->current_side * MAX_LANES + local_gate;
+
+        printf("[Vehicle %d - %s] Waiting for %s gate %d on Side %d...\n",
+               v->id, vehicle_type_str(v->type), lane_kind_str(lanes[local_gate]), local_gate, v->current_side);
         
         // Gate waiting start
+        vehicle_beat(v, STAGE_TOLL_QUEUE);
         clock_gettime(CLOCK_MONOTONIC, &wait_start);
+        BUMP(toll_queue[toll_index], 1);
         sem_wait(toll[toll_index]);
         clock_gettime(CLOCK_MONOTONIC, &wait_end);
         v->total_wait_time += (wait_end.tv_sec - wait_start.tv_sec) * 1000000000LL +
                               (wait_end.tv_nsec - wait_start.tv_nsec);
 
-        printf("[Vehicle %d - %s] Passing through gate on Side %d...\n",
-               v->id, vehicle_type_str(v->type), v->current_side);
-        sleep(3);
+        printf("[Vehicle %d - %s] Passing through gate on Side %d (%s)...\n",
+               v->id, vehicle_type_str(v->type), v->current_side, v->has_tag ? "tag" : "cash");
+        vehicle_beat(v, STAGE_TOLL_SERVICE);
+        long long service_start = now_ns();
+        sleep_ms(toll_service_time_ms(v));
+        BUMP(lane_busy_ns[toll_index], now_ns() - service_start);
+        BUMP(lane_served[toll_index], 1);
         sem_post(toll[toll_index]);
+        BUMP(toll_queue[toll_index], -1);
 
-        printf("[Vehicle %d - %s] Waiting in holding area on Side %d...\n",
-               v->id, vehicle_type_str(v->type), v->current_side);
+        int reserved = v->booking >= 0;
+        long long square_start = 0;
+        if (reserved) {
+            // Booked vehicles skip the holding area and park in the reserved lane
+            printf("[Vehicle %d - %s] Proceeding to reserved lane on Side %d...\n",
+                   v->id, vehicle_type_str(v->type), v->current_side);
+            vehicle_beat(v, STAGE_SETTLING);
+            sleep(3);
+        } else {
+            printf("[Vehicle %d - %s] Waiting in holding area on Side %d...\n",
+                   v->id, vehicle_type_str(v->type), v->current_side);
 
-        // Holding area waiting start
-        clock_gettime(CLOCK_MONOTONIC, &wait_start);
-        sem_wait(square[v->current_side]);
-        clock_gettime(CLOCK_MONOTONIC, &wait_end);
-        v->total_wait_time += (wait_end.tv_sec - wait_start.tv_sec) * 1000000000LL +
-                              (wait_end.tv_nsec - wait_start.tv_nsec);
-        sleep(3);
+            // Holding area waiting start
+            vehicle_beat(v, STAGE_SQUARE_QUEUE);
+            clock_gettime(CLOCK_MONOTONIC, &wait_start);
+            sem_wait(square[v->current_side]);
+            BUMP(square_occupancy[v->current_side], 1);
+            clock_gettime(CLOCK_MONOTONIC, &wait_end);
+            v->total_wait_time += (wait_end.tv_sec - wait_start.tv_sec) * 1000000000LL +
+                                  (wait_end.tv_nsec - wait_start.tv_nsec);
+            square_start = now_ns();
+            vehicle_beat(v, STAGE_SETTLING);
+            sleep(3);
+        }
 
-        pthread_mutex_lock(&ferry_mutex);
+        ferry_lock();
         pending_on_side[v->current_side]--;
-        vehicles_waiting[v->current_side]++;
-        pthread_mutex_unlock(&ferry_mutex);
+        if (reserved) {
+            lane_ready[v->booking & (BOOKING_WINDOW - 1)][v->type]++;
+        } else {
+            vehicles_waiting[v->current_side]++;
+            waiting_by_type[v->current_side][v->type]++;
+        }
+        pthread_cond_signal(&ferry_full);
+        ferry_unlock();
 
         int boarded = 0;
+        int pos = 0;
+        vehicle_beat(v, STAGE_AWAITING_FERRY);
         // Ferry waiting start
         clock_gettime(CLOCK_MONOTONIC, &wait_start);
         while (!boarded) {
-            pthread_mutex_lock(&ferry_mutex);
-            if (ferry_side == v->current_side &&
-                ferry_load + v->type <= CAPACITY) {
+            ferry_lock();
+            if (reserved && v->booking < total_ferry_crossings) {
+                // Missed or bumped from an overbooked departure: book the next one
+                lane_ready[v->booking & (BOOKING_WINDOW - 1)][v->type]--;
+                booking_cancel(v->booking, v->type);
+                v->booking = booking_find(v->current_side, total_ferry_crossings, v->type);
+                BUMP(bookings_rebooked, 1);
+                if (v->booking < 0) {
+                    // Window full: fall back to walk-up, without a holding-area slot
+                    reserved = 0;
+                    vehicles_waiting[v->current_side]++;
+                    waiting_by_type[v->current_side][v->type]++;
+                } else {
+                    lane_ready[v->booking & (BOOKING_WINDOW - 1)][v->type]++;
+                }
+                pthread_cond_signal(&ferry_full);
+            }
+            // Signed on purpose: VehicleType is unsigned, and room may not go below zero
+            int room = reserved ? CAPACITY : CAPACITY - outstanding_reserved_units();
+            if (room < 0)
+                room = 0;
+            if (ferry_side == v->current_side && ferry_docked && !ferry_closing &&
+                (!reserved || v->booking == total_ferry_crossings) &&
+                ferry_load + (int)v->type <= room) {
 
-                printf("[Vehicle %d - %s] Boarding ferry on Side %d (load: %d/%d)...\n",
-                       v->id, vehicle_type_str(v->type), v->current_side, ferry_load, CAPACITY);
+                printf("[Vehicle %d - %s] Boarding ferry on Side %d (load: %d/%d)%s...\n",
+                       v->id, vehicle_type_str(v->type), v->current_side, ferry_load, CAPACITY,
+                       reserved ? " with reservation" : "");
 
                 ferry_load += v->type;
+                pos = vehicle_count;
                 vehicles_on_ferry[vehicle_count++] = v->id;
 
-                vehicles_waiting[v->current_side]--;
+                if (reserved) {
+                    lane_ready[v->booking & (BOOKING_WINDOW - 1)][v->type]--;
+                    reserved_boarded_units += v->type;
+                } else {
+                    vehicles_waiting[v->current_side]--;
+                    waiting_by_type[v->current_side][v->type]--;
+                }
                 vehicles_remaining--;
 
                 pthread_cond_signal(&ferry_full);
                 boarded = 1;
             }
-            pthread_mutex_unlock(&ferry_mutex);
+            ferry_unlock();
             if (!boarded) sleep(2);
         }
         // Ferry waiting end
         clock_gettime(CLOCK_MONOTONIC, &wait_end);
-        v->total_wait_time += (wait_end.tv_sec - wait_start.tv_sec) * 1000000000LL +
-                              (wait_end.tv_nsec - wait_start.tv_nsec);
-        
-        while (v->current_side == ferry_side) {
-            sleep(2);
+        long long board_wait = (wait_end.tv_sec - wait_start.tv_sec) * 1000000000LL +
+                               (wait_end.tv_nsec - wait_start.tv_nsec);
+        v->total_wait_time += board_wait;
+        BUMP(board_wait_ns[v->booking >= 0], board_wait);
+        BUMP(board_wait_count[v->booking >= 0], 1);
+
+        // Drive up the ramp in boarding order; the holding-area slot is free once on the ramp
+        int boarded_side = v->current_side;
+        long long load_start = now_ns();
+        if (square_start > 0) {
+            BUMP(square_slot_ns, load_start - square_start);
+            BUMP(square_occupancy[boarded_side], -1);
+            sem_post(square[boarded_side]);
         }
+        vehicle_beat(v, STAGE_LOADING);
+        ramp_transfer(pos, &load_next, 1, load_ms[v->type]);
+        vehicle_beat(v, STAGE_ON_BOARD);
+
+        ferry_lock();
+        if (load_first_start_ns == 0 || load_start < load_first_start_ns)
+            load_first_start_ns = load_start;
+        load_last_end_ns = now_ns();
+        loaded_count++;
+        pthread_cond_signal(&ferry_full);
+
+        // Wait for the other side, then leave last on, first off
+        while (ferry_side == boarded_side || !ferry_unloading) {
+            ferry_wait(&dock_cond);
+        }
+        int new_side = ferry_side;
+        ferry_unlock();
+
+        vehicle_beat(v, STAGE_UNLOADING);
+        ramp_transfer(pos, &unload_next, -1, unload_ms[v->type]);
+
+        ferry_lock();
+        unloaded_count++;
+        pthread_cond_broadcast(&dock_cond);
+        ferry_unlock();
 
         printf("[Vehicle %d - %s] Disembarked from ferry. New side: %d\n",
-               v->id, vehicle_type_str(v->type), ferry_side);
-        sem_post(square[ferry_side]);
+               v->id, vehicle_type_str(v->type), new_side);
 
-        v->current_side = ferry_side;
-        if (trip == 1) { // Round trip completed
+        v->current_side = new_side;
+        if (trip == trips - 1) { // Round trip (open mode: single trip) completed
             v->returned = 1;
             // Record the time the vehicle exits the system
             clock_gettime(CLOCK_MONOTONIC, &v->end_time);
         }
 
-        sleep(rand() % 5 + 3);
+        if (!open_cfg.enabled) {
+            vehicle_beat(v, STAGE_RESTING);
+            sleep(rand() % 5 + 3);
+        }
+    }
+
+    vehicle_beat(v, STAGE_LEAVING);
+
+    if (open_cfg.enabled) {
+        // The vehicle leaves: record it and hand its slot back to the pool
+        vehicle_beat(v, STAGE_DONE);
+        stats_record(v);
+        pool_release(v);
+
+        ferry_lock();
+        vehicles_in_system--;
+        pthread_cond_signal(&ferry_full);
+        ferry_unlock();
+    } else {
+        ferry_lock();
+        vehicles_in_system--;
+        ferry_unlock();
+        vehicle_beat(v, STAGE_DONE);
     }
 
     pthread_exit(NULL);
 }
 
 void *ferry_thread(void *arg) {
-    // Record the simulation start time (when ferry thread starts)
-    clock_gettime(CLOCK_MONOTONIC, &simulation_start_time);
+    long long arrival_ns = now_ns();  // Start of the current dwell
+    long long unloading = 0;          // Docking plus unloading of the current dwell
+    int unloaded = 0;
 
+    self_agent = FERRY_AGENT;
+    heartbeat(FERRY_AGENT, -1, STAGE_STARTING);
     while (1) {
         pthread_mutex_lock(&start_mutex);
         while (!start_signal_given) {
@@ -172,47 +940,478 @@ void *ferry_thread(void *arg) {
         }
         pthread_mutex_unlock(&start_mutex);
 
-        pthread_mutex_lock(&ferry_mutex);
+        ferry_lock();
+        // In open mode an empty system parks the ferry until the next arrival
+        if (open_cfg.enabled && vehicles_in_system == 0 && !arrivals_closed)
+            heartbeat(FERRY_AGENT, -1, STAGE_FERRY_PARKED);
+        while (open_cfg.enabled && vehicles_in_system == 0 && !arrivals_closed) {
+            ferry_wait(&ferry_full);
+        }
+        heartbeat(FERRY_AGENT, -1, STAGE_FERRY_BOARDING);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += departure_timeout;
+
         while (ferry_load < CAPACITY &&
-               (vehicles_waiting[ferry_side] + pending_on_side[ferry_side]) > 0) {
+               (pending_on_side[ferry_side] > 0 || waiting_vehicle_fits() || reserved_vehicle_fits())) {
             // If all vehicles have returned and the ferry is empty, terminate the thread
-            if (vehicles_remaining == 0 && ferry_load == 0 && 
-                vehicles_waiting[0] == 0 && vehicles_waiting[1] == 0 && 
-                pending_on_side[0] == 0 && pending_on_side[1] == 0) {
-                pthread_mutex_unlock(&ferry_mutex);
+            if (simulation_finished()) {
+                ferry_unlock();
                 goto end_ferry_thread;
             }
-            pthread_cond_wait(&ferry_full, &ferry_mutex);
+            if (departure_timeout > 0) {
+                // Leave with a partial load rather than wait for a full ferry
+                if (ferry_timedwait(&ferry_full, &deadline) == ETIMEDOUT)
+                    break;
+            } else {
+                ferry_wait(&ferry_full);
+            }
         }
 
         // Check again if simulation should end after waiting
-        if (vehicles_remaining == 0 && ferry_load == 0 && 
-            vehicles_waiting[0] == 0 && vehicles_waiting[1] == 0 && 
-            pending_on_side[0] == 0 && pending_on_side[1] == 0) {
-            pthread_mutex_unlock(&ferry_mutex);
+        if (simulation_finished()) {
+            ferry_unlock();
             break;
         }
 
+        // Stop boarding and let the vehicles already on the ramps finish loading
+        ferry_closing = 1;
+        heartbeat(FERRY_AGENT, -1, STAGE_FERRY_CLOSING);
+        while (loaded_count < vehicle_count) {
+            ferry_wait(&ferry_full);
+        }
+
+        long long depart_ns = now_ns();
+        long long dwell = depart_ns - arrival_ns;
+        long long loading = vehicle_count > 0 ? load_last_end_ns - load_first_start_ns : 0;
+        long long waiting = dwell - unloading - loading;
+        if (waiting < 0)
+            waiting = 0;
+        dwell_total_ns += dwell;
+        dwell_unload_ns += unloading;
+        dwell_load_ns += loading;
+        dwell_wait_ns += waiting;
+
         printf("\n=== Ferry departing from Side %d (load: %d/%d) ===\n", ferry_side, ferry_load, CAPACITY);
+        printf("=== Dwell %.1fs: docking and unloading %.1fs (%d vehicles), loading %.1fs (%d vehicles), waiting %.1fs ===\n",
+               dwell / 1e9, unloading / 1e9, unloaded, loading / 1e9, vehicle_count, waiting / 1e9);
+        ferry_docked = 0;
+        ferry_unlock();
+
+        heartbeat(FERRY_AGENT, -1, STAGE_FERRY_SAILING);
         sleep(4);
+
+        ferry_lock();
         ferry_side = 1 - ferry_side;
+        total_ferry_crossings++;
         printf("=== Ferry arrived at Side %d ===\n\n", ferry_side);
-        
+        ferry_unlock();
+
+        // Turnaround follows the manifest: docking, then unloading on the ramps
+        arrival_ns = now_ns();
+        heartbeat(FERRY_AGENT, -1, STAGE_FERRY_DOCKING);
+        sleep_ms(DOCKING_MS);
+
+        ferry_lock();
+        unloaded = vehicle_count;
+        unload_next = vehicle_count - 1;
+        unloaded_count = 0;
+        ferry_unloading = 1;
+        heartbeat(FERRY_AGENT, -1, STAGE_FERRY_UNLOADING);
+        pthread_cond_broadcast(&dock_cond);
+        while (unloaded_count < vehicle_count) {
+            ferry_wait(&dock_cond);
+        }
+        unloading = now_ns() - arrival_ns;
+
+        ferry_unloading = 0;
         ferry_load = 0;
         vehicle_count = 0;
-
-        pthread_mutex_unlock(&ferry_mutex);
-        sleep(3);
+        reserved_boarded_units = 0;
+        load_next = 0;
+        loaded_count = 0;
+        load_first_start_ns = 0;
+        load_last_end_ns = 0;
+        ferry_closing = 0;
+        ferry_docked = 1;
+        ferry_unlock();
     }
 
 end_ferry_thread:
+    heartbeat(FERRY_AGENT, -1, STAGE_DONE);
     // Record the simulation end time (when ferry thread terminates)
     clock_gettime(CLOCK_MONOTONIC, &simulation_end_time);
     pthread_exit(NULL);
 }
 
+void put_varint(unsigned char **out, unsigned long long v) {
+    while (v >= 0x80) {
+        *(*out)++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *(*out)++ = (unsigned char)v;
+}
+
+unsigned long long get_varint(const unsigned char **in, const unsigned char *end) {
+    unsigned long long v = 0;
+    for (int shift = 0; *in < end && shift < 64; shift += 7) {
+        unsigned char byte = *(*in)++;
+        v |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    return v;
+}
+
+unsigned long long zigzag(long long v) {
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+long long unzigzag(unsigned long long v) {
+    return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+// Block layout: rows, then per column its byte length and zigzag varint deltas
+void write_sample_block(FILE *f, const SampleBlock *b) {
+    static unsigned char buf[SAMPLE_ROWS * 10];
+    unsigned char header[16], *h = header;
+    put_varint(&h, (unsigned long long)b->rows);
+    fwrite(header, 1, h - header, f);
+
+    for (int c = -1; c < SAMPLE_COLUMNS; ++c) {
+        unsigned char *out = buf;
+        long long prev = 0;
+        for (int r = 0; r < b->rows; ++r) {
+            long long v = c < 0 ? b->t_ns[r] : b->col[c][r];
+            put_varint(&out, zigzag(v - prev));
+            prev = v;
+        }
+        h = header;
+        put_varint(&h, (unsigned long long)(out - buf));
+        fwrite(header, 1, h - header, f);
+        fwrite(buf, 1, out - buf, f);
+    }
+}
+
+// Encodes and writes full blocks so the sampler never blocks on I/O
+void *sample_writer_thread(void *arg) {
+    pthread_mutex_lock(&sample_mutex);
+    while (1) {
+        while (sample_pending < 0 && !sampler_done) {
+            pthread_cond_wait(&sample_cond, &sample_mutex);
+        }
+        if (sample_pending < 0)
+            break;
+        int idx = sample_pending;
+        pthread_mutex_unlock(&sample_mutex);
+
+        write_sample_block(sample_file, &sample_blocks[idx]);
+        sample_blocks[idx].rows = 0;
+
+        pthread_mutex_lock(&sample_mutex);
+        sample_pending = -1;
+    }
+    pthread_mutex_unlock(&sample_mutex);
+    pthread_exit(NULL);
+}
+
+void take_sample(SampleBlock *b) {
+    int r = b->rows;
+    b->t_ns[r] = since_start_ns(now_ns());
+    int c = 0;
+    b->col[c++][r] = PEEK(pending_on_side[0]);
+    b->col[c++][r] = PEEK(pending_on_side[1]);
+    b->col[c++][r] = PEEK(vehicles_waiting[0]);
+    b->col[c++][r] = PEEK(vehicles_waiting[1]);
+    for (int g = 0; g < 2 * MAX_LANES; ++g) {
+        b->col[c++][r] = PEEK(toll_queue[g]);
+    }
+    b->col[c++][r] = PEEK(square_occupancy[0]);
+    b->col[c++][r] = PEEK(square_occupancy[1]);
+    b->col[c++][r] = PEEK(ferry_load);
+    b->col[c++][r] = PEEK(ferry_side);
+    b->col[c++][r] = PEEK(vehicle_count);
+    b->col[c++][r] = PEEK(vehicles_in_system);
+    b->col[c++][r] = PEEK(total_ferry_crossings);
+    b->rows = r + 1;
+}
+
+// Samples the shared counters at a fixed wall-clock interval
+void *sampler_thread(void *arg) {
+    long long next = timespec_to_ns(simulation_start_time);
+    while (1) {
+        pthread_mutex_lock(&sample_mutex);
+        int done = sampler_done;
+        pthread_mutex_unlock(&sample_mutex);
+        if (done)
+            break;
+
+        SampleBlock *b = &sample_blocks[sample_active];
+        take_sample(b);
+        if (b->rows == SAMPLE_ROWS) {
+            pthread_mutex_lock(&sample_mutex);
+            if (sample_pending < 0) {
+                sample_pending = sample_active;
+                sample_active = 1 - sample_active;
+                pthread_cond_signal(&sample_cond);
+            } else {
+                samples_dropped++;
+                b->rows = 0;
+            }
+            pthread_mutex_unlock(&sample_mutex);
+        }
+
+        next += sample_interval_ms * 1000000LL;
+        sleep_until_ns(next, 0);
+    }
+    pthread_exit(NULL);
+}
+
+int sampler_start(pthread_t *sthread, pthread_t *wthread) {
+    sample_file = fopen(sample_path, "wb");
+    if (sample_file == NULL) {
+        perror("fopen sample file failed");
+        return -1;
+    }
+    fwrite(SAMPLE_MAGIC, 1, strlen(SAMPLE_MAGIC), sample_file);
+    unsigned char header[32], *h = header;
+    put_varint(&h, SAMPLE_COLUMNS);
+    put_varint(&h, CAPACITY);
+    put_varint(&h, (unsigned long long)sample_interval_ms);
+    fwrite(header, 1, h - header, sample_file);
+    for (int c = 0; c < SAMPLE_COLUMNS; ++c) {
+        fprintf(sample_file, "%s%c", sample_column_names[c], '\0');
+    }
+
+    pthread_create(wthread, NULL, sample_writer_thread, NULL);
+    pthread_create(sthread, NULL, sampler_thread, NULL);
+    sample_threads[0] = *sthread;
+    sample_threads[1] = *wthread;
+    return 0;
+}
+
+void sampler_stop(pthread_t sthread, pthread_t wthread) {
+    pthread_mutex_lock(&sample_mutex);
+    sampler_done = 1;
+    pthread_mutex_unlock(&sample_mutex);
+    pthread_join(sthread, NULL);
+
+    // Hand the partial block to the writer once it is idle
+    pthread_mutex_lock(&sample_mutex);
+    while (sample_pending >= 0) {
+        pthread_mutex_unlock(&sample_mutex);
+        usleep(1000);
+        pthread_mutex_lock(&sample_mutex);
+    }
+    if (sample_blocks[sample_active].rows > 0)
+        sample_pending = sample_active;
+    pthread_cond_signal(&sample_cond);
+    pthread_mutex_unlock(&sample_mutex);
+    pthread_join(wthread, NULL);
+
+    fclose(sample_file);
+    if (samples_dropped > 0)
+        printf("Sampler dropped %lld blocks (writer fell behind)\n", samples_dropped);
+}
+
+// Decodes a sample file and prints it as CSV
+int dump_samples(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror("fopen sample file failed");
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = malloc(size > 0 ? size : 1);
+    if (fread(data, 1, size, f) != (size_t)size || size < (long)strlen(SAMPLE_MAGIC) ||
+        memcmp(data, SAMPLE_MAGIC, strlen(SAMPLE_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a sample file\n", path);
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    const unsigned char *in = data + strlen(SAMPLE_MAGIC), *end = data + size;
+    int columns = (int)get_varint(&in, end);
+    int capacity = (int)get_varint(&in, end);
+    get_varint(&in, end); // Interval
+    if (columns != SAMPLE_COLUMNS) {
+        fprintf(stderr, "Unexpected column count %d\n", columns);
+        free(data);
+        return -1;
+    }
+    int load_column = 0;
+    const unsigned char *names = in;
+    for (int c = 0; c < columns; ++c) {
+        const unsigned char *nul = in < end ? memchr(in, 0, end - in) : NULL;
+        if (nul == NULL) {
+            fprintf(stderr, "%s: truncated header\n", path);
+            free(data);
+            return -1;
+        }
+        if (strcmp((const char *)in, "ferry_load") == 0)
+            load_column = c;
+        in = nul + 1;
+    }
+    printf("t_s");
+    for (const unsigned char *name = names; name < in; name += strlen((const char *)name) + 1) {
+        printf(",%s", (const char *)name);
+    }
+    printf(",utilization\n");
+
+    // A run cut short (Ctrl+C, crash, stall abort) leaves a partial last block
+    static SampleBlock b;
+    long long block = 0;
+    while (in < end) {
+        unsigned long long rows = get_varint(&in, end);
+        int truncated = in >= end || rows > SAMPLE_ROWS;
+        b.rows = (int)rows;
+        for (int c = -1; c < columns && !truncated; ++c) {
+            unsigned long long col_bytes = get_varint(&in, end);
+            if (col_bytes > (unsigned long long)(end - in)) {
+                truncated = 1;
+                break;
+            }
+            const unsigned char *col_end = in + col_bytes;
+            long long prev = 0;
+            for (int r = 0; r < b.rows; ++r) {
+                prev += unzigzag(get_varint(&in, col_end));
+                if (c < 0)
+                    b.t_ns[r] = prev;
+                else
+                    b.col[c][r] = (int)prev;
+            }
+            in = col_end;
+        }
+        if (truncated) {
+            fprintf(stderr, "%s: block %lld is truncated, stopping\n", path, block);
+            break;
+        }
+        block++;
+        for (int r = 0; r < b.rows; ++r) {
+            printf("%.3f", b.t_ns[r] / 1e9);
+            for (int c = 0; c < columns; ++c) {
+                printf(",%d", b.col[c][r]);
+            }
+            printf(",%.3f\n", (double)b.col[load_column][r] / capacity);
+        }
+    }
+    free(data);
+    return 0;
+}
+
+// Arrival rate at time t (seconds since start), with an optional sinusoidal daily profile
+double arrival_rate_at(double t) {
+    double rate = open_cfg.arrival_rate;
+    if (open_cfg.profile_amplitude > 0)
+        rate *= 1.0 + open_cfg.profile_amplitude * sin(2.0 * M_PI * t / open_cfg.profile_period);
+    return rate > 0 ? rate : 0;
+}
+
+VehicleType random_vehicle_type(unsigned int *seed) {
+    int r = rand_r(seed) % TOTAL_VEHICLES;
+    if (r < TOTAL_CARS)
+        return CAR;
+    if (r < TOTAL_CARS + TOTAL_MINIBUSES)
+        return MINIBUS;
+    return TRUCK;
+}
+
+// Generates a non-homogeneous Poisson arrival stream by thinning
+void *arrival_thread(void *arg) {
+    unsigned int seed = (unsigned int)time(NULL) ^ 0x9e3779b9u;
+    double rate_max = open_cfg.arrival_rate * (1.0 + open_cfg.profile_amplitude);
+    long long start = timespec_to_ns(simulation_start_time);
+    double t = 0.0;
+
+    self_agent = ARRIVAL_AGENT;
+    heartbeat(ARRIVAL_AGENT, -1, STAGE_ARRIVALS);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    while (!stop_requested && rate_max > 0) {
+        double u = (rand_r(&seed) + 1.0) / ((double)RAND_MAX + 2.0);
+        t += -log(u) / rate_max;
+        if (open_cfg.duration > 0 && t >= open_cfg.duration)
+            break;
+
+        sleep_until_ns(start + (long long)(t * 1e9), 1);
+        if (stop_requested)
+            break;
+
+        if ((double)rand_r(&seed) / RAND_MAX * rate_max > arrival_rate_at(t))
+            continue;
+
+        Vehicle *v = pool_acquire();
+        if (v == NULL) {
+            pthread_mutex_lock(&stats_mutex);
+            stats_rejected++;
+            pthread_mutex_unlock(&stats_mutex);
+            continue;
+        }
+
+        int side = rand_r(&seed) % 2;
+        *v = (Vehicle){next_vehicle_id++, random_vehicle_type(&seed), side, side, 0, {0,0}, {0,0}, 0LL,
+                       rand_r(&seed) < tag_share * RAND_MAX};
+        clock_gettime(CLOCK_MONOTONIC, &v->start_time);
+
+        ferry_lock();
+        vehicles_in_system++;
+        pthread_cond_signal(&ferry_full);
+        ferry_unlock();
+
+        pthread_t vt;
+        if (pthread_create(&vt, &attr, vehicle_thread, v) != 0) {
+            perror("pthread_create vehicle failed");
+            ferry_lock();
+            vehicles_in_system--;
+            ferry_unlock();
+            pool_release(v);
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    ferry_lock();
+    printf("\n*** Arrivals closed, draining %d vehicles ***\n\n", vehicles_in_system);
+    arrivals_closed = 1;
+    pthread_cond_signal(&ferry_full);
+    ferry_unlock();
+    heartbeat(ARRIVAL_AGENT, -1, STAGE_DONE);
+    pthread_exit(NULL);
+}
+
+// Prints sliding-window statistics at a fixed interval
+void *reporter_thread(void *arg) {
+    long long next = now_ns() + (long long)(open_cfg.report_interval * 1e9);
+    while (1) {
+        pthread_mutex_lock(&stats_mutex);
+        int done = reporter_done;
+        pthread_mutex_unlock(&stats_mutex);
+        if (done)
+            break;
+        if (now_ns() >= next) {
+            stats_report_window();
+            next += (long long)(open_cfg.report_interval * 1e9);
+        }
+        usleep(100000);
+    }
+    pthread_exit(NULL);
+}
+
+// First Ctrl+C drains the run; a second one kills it
+void handle_sigint(int sig) {
+    (void)sig;
+    stop_requested = 1;
+    signal(SIGINT, SIG_DFL);
+}
+
 void init_named_semaphores() {
-    for (int i = 0; i < 4; ++i) {
+    for (int i = 0; i < 2 * MAX_LANES; ++i) {
         char name[16];
         sprintf(name, "/toll%d", i);
         sem_unlink(name); // Clean up any previous semaphores
@@ -233,34 +1432,827 @@ void init_named_semaphores() {
             exit(EXIT_FAILURE);
         }
     }
+
+    sem_unlink("/ramp"); // Clean up any previous semaphores
+    ramp = sem_open("/ramp", O_CREAT, 0644, ramp_count);
+    if (ramp == SEM_FAILED) {
+        perror("sem_open ramp failed");
+        exit(EXIT_FAILURE);
+    }
 }
 
-void cleanup_named_semaphores() {
-    for (int i = 0; i < 4; ++i) {
-        char name[16];
+// Removes the names only; open handles stay valid until the process exits
+void unlink_named_semaphores() {
+    char name[16];
+    for (int i = 0; i < 2 * MAX_LANES; ++i) {
         sprintf(name, "/toll%d", i);
-        sem_close(toll[i]);
         sem_unlink(name);
     }
-
     for (int i = 0; i < 2; ++i) {
-        char name[16];
         sprintf(name, "/square%d", i);
-        sem_close(square[i]);
         sem_unlink(name);
     }
+    sem_unlink("/ramp");
+}
+
+void cleanup_named_semaphores() {
+    for (int i = 0; i < 2 * MAX_LANES; ++i) {
+        sem_close(toll[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        sem_close(square[i]);
+    }
+    sem_close(ramp);
+    unlink_named_semaphores();
+}
+
+const char *stage_str(AgentStage stage) {
+    switch (stage) {
+        case STAGE_STARTING: return "starting";
+        case STAGE_TOLL_QUEUE: return "queued at toll";
+        case STAGE_TOLL_SERVICE: return "paying toll";
+        case STAGE_SQUARE_QUEUE: return "queued for holding area";
+        case STAGE_SETTLING: return "entering holding area";
+        case STAGE_AWAITING_FERRY: return "awaiting ferry";
+        case STAGE_LOADING: return "loading";
+        case STAGE_ON_BOARD: return "on board";
+        case STAGE_UNLOADING: return "unloading";
+        case STAGE_RESTING: return "resting";
+        case STAGE_LEAVING: return "leaving";
+        case STAGE_FERRY_PARKED: return "parked, system empty";
+        case STAGE_FERRY_BOARDING: return "boarding";
+        case STAGE_FERRY_CLOSING: return "closing ramps";
+        case STAGE_FERRY_SAILING: return "sailing";
+        case STAGE_FERRY_DOCKING: return "docking";
+        case STAGE_FERRY_UNLOADING: return "unloading";
+        case STAGE_ARRIVALS: return "generating arrivals";
+        case STAGE_DONE: return "done";
+        default: return "unknown";
+    }
+}
+
+const char *agent_name(int agent, char *buf, size_t len) {
+    if (agent == FERRY_AGENT) return "ferry";
+    if (agent == ARRIVAL_AGENT) return "arrivals";
+    if (agent == -2) return "helper thread";
+    if (agent < 0) return "nobody";
+    snprintf(buf, len, "vehicle %d", PEEK(heartbeats[agent].vehicle_id));
+    return buf;
+}
+
+// Probes a mutex without blocking; the owner is unknown except for ferry_mutex
+const char *mutex_state(pthread_mutex_t *m) {
+    if (pthread_mutex_trylock(m) != 0)
+        return "held";
+    pthread_mutex_unlock(m);
+    return "free";
+}
+
+// Reads everything without locks: the thread holding ferry_mutex may be the one stuck
+void dump_stall(const char *reason, double idle_s) {
+    long long now = now_ns();
+    char name[32];
+
+    fprintf(stderr, "\n!!! Watchdog: %s for %.0f seconds (stall %d) !!!\n", reason, idle_s, stalls_detected);
+    fprintf(stderr, "Agents:\n");
+    for (int agent = 0; agent < HEARTBEAT_SLOTS; ++agent) {
+        int stage = __atomic_load_n(&heartbeats[agent].stage, __ATOMIC_ACQUIRE);
+        if (stage == STAGE_NONE || stage == STAGE_DONE)
+            continue;
+        long long since = PEEK(heartbeats[agent].since_ns);
+        fprintf(stderr, "  %-12s %-24s for %6.1fs\n",
+                agent_name(agent, name, sizeof(name)), stage_str(stage), (now - since) / 1e9);
+    }
+
+    fprintf(stderr, "Queues:\n");
+    for (int side = 0; side < 2; ++side) {
+        fprintf(stderr, "  Side %d: pending %d, waiting %d (cars %d, minibuses %d, trucks %d), holding area %d, gates",
+                side, PEEK(pending_on_side[side]), PEEK(vehicles_waiting[side]),
+                PEEK(waiting_by_type[side][CAR]), PEEK(waiting_by_type[side][MINIBUS]),
+                PEEK(waiting_by_type[side][TRUCK]), PEEK(square_occupancy[side]));
+        for (int lane = 0; lane < lane_count; ++lane)
+            fprintf(stderr, " %d", PEEK(toll_queue[side * MAX_LANES + lane]));
+        fprintf(stderr, "\n");
+    }
+    long long d = PEEK(total_ferry_crossings);
+    int *ready = lane_ready[d & (BOOKING_WINDOW - 1)];
+    fprintf(stderr, "  Ferry: side %d, load %d/%d, %d aboard, docked %d, closing %d, unloading %d\n",
+            PEEK(ferry_side), PEEK(ferry_load), CAPACITY, PEEK(vehicle_count),
+            PEEK(ferry_docked), PEEK(ferry_closing), PEEK(ferry_unloading));
+    fprintf(stderr, "  Ramps: load turn %d (%d loaded), unload turn %d (%d unloaded)\n",
+            PEEK(load_next), PEEK(loaded_count), PEEK(unload_next), PEEK(unloaded_count));
+    fprintf(stderr, "  Departure %lld: %d units booked, reserved lane %d/%d/%d; in system %d, crossings %lld\n",
+            d, booking_units(d), PEEK(ready[CAR]), PEEK(ready[MINIBUS]), PEEK(ready[TRUCK]),
+            PEEK(vehicles_in_system), d);
+
+    fprintf(stderr, "Locks:\n");
+    fprintf(stderr, "  ferry_mutex: %s\n", agent_name(PEEK(ferry_mutex_owner), name, sizeof(name)));
+    fprintf(stderr, "  start_mutex: %s, stats_mutex: %s, pool_mutex: %s, sample_mutex: %s\n",
+            mutex_state(&start_mutex), mutex_state(&stats_mutex),
+            mutex_state(&pool_mutex), mutex_state(&sample_mutex));
+    fflush(stderr);
+}
+
+int vehicles_awaiting_ferry() {
+    int n = 0;
+    for (int agent = VEHICLE_AGENT_BASE; agent < HEARTBEAT_SLOTS; ++agent) {
+        n += __atomic_load_n(&heartbeats[agent].stage, __ATOMIC_ACQUIRE) == STAGE_AWAITING_FERRY;
+    }
+    return n;
+}
+
+// Declares a stall when no agent changes stage for stall_timeout seconds, or when the
+// ferry and the vehicles on its ramps make no progress that long while others wait for
+// it. The second check matters in open mode, where arrivals keep the global count moving.
+// A ferry parked on an empty open system is idle, not stalled.
+void *watchdog_thread(void *arg) {
+    long long timeout_ns = stall_timeout * 1000000000LL;
+    long long last_count = PEEK(progress_count);
+    long long last_change = now_ns();
+    long long last_report = 0;
+
+    while (!PEEK(watchdog_done)) {
+        usleep(200000);
+        long long count = PEEK(progress_count);
+        long long now = now_ns();
+        int ferry_stage = __atomic_load_n(&heartbeats[FERRY_AGENT].stage, __ATOMIC_ACQUIRE);
+        if (count != last_count || ferry_stage == STAGE_FERRY_PARKED) {
+            last_count = count;
+            last_change = now;
+        }
+
+        const char *reason = NULL;
+        double idle_s = 0;
+        if (now - last_change >= timeout_ns) {
+            reason = "no progress";
+            idle_s = (now - last_change) / 1e9;
+        } else if (ferry_stage >= STAGE_FERRY_BOARDING && ferry_stage <= STAGE_FERRY_UNLOADING &&
+                   now - PEEK(ferry_progress_ns) >= timeout_ns && vehicles_awaiting_ferry() > 0) {
+            reason = "ferry stuck while vehicles wait";
+            idle_s = (now - PEEK(ferry_progress_ns)) / 1e9;
+        }
+        // One dump per window while the condition lasts
+        if (reason == NULL || now - last_report < timeout_ns)
+            continue;
+        last_report = now;
+
+        stalls_detected++;
+        dump_stall(reason, idle_s);
+        if (stall_abort) {
+            // The sampler never takes ferry_mutex, so it can still finish its last block;
+            // the result stream is flushed only if stats_mutex is not the stuck lock.
+            // stats_mutex stays held so no vehicle can write to the closed stream, and
+            // the semaphores are only unlinked because live threads still use them.
+            fprintf(stderr, "Watchdog: aborting run\n");
+            if (sample_path != NULL)
+                sampler_stop(sample_threads[0], sample_threads[1]);
+            if (results_file != NULL && pthread_mutex_trylock(&stats_mutex) == 0) {
+                fclose(results_file);
+                results_file = NULL;
+            }
+            fflush(stdout);
+            unlink_named_semaphores();
+            _exit(STALL_EXIT_CODE);
+        }
+    }
+    pthread_exit(NULL);
+}
+
+void watchdog_start(pthread_t *thread) {
+    if (stall_timeout > 0)
+        pthread_create(thread, NULL, watchdog_thread, NULL);
+}
+
+void watchdog_stop(pthread_t thread) {
+    if (stall_timeout <= 0)
+        return;
+    __atomic_store_n(&watchdog_done, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+    if (stalls_detected > 0)
+        printf("Watchdog: %d stalls detected\n", stalls_detected);
+}
+
+void print_dwell_stats() {
+    if (total_ferry_crossings == 0)
+        return;
+    printf("Average dwell at the dock: %.2f seconds (docking and unloading %.2f, loading %.2f, waiting %.2f) with %d ramps\n",
+           dwell_total_ns / 1e9 / total_ferry_crossings, dwell_unload_ns / 1e9 / total_ferry_crossings,
+           dwell_load_ns / 1e9 / total_ferry_crossings, dwell_wait_ns / 1e9 / total_ferry_crossings, ramp_count);
+}
+
+void print_reservation_stats(long long runtime_ns) {
+    printf("Average holding-area occupancy: %.2f vehicles\n",
+           runtime_ns > 0 ? (double)square_slot_ns / runtime_ns : 0.0);
+    if (board_wait_count[0] > 0)
+        printf("Walk-up boarding wait: %.2f seconds average (%lld trips)\n",
+               board_wait_ns[0] / 1e9 / board_wait_count[0], board_wait_count[0]);
+    if (reserve_share <= 0)
+        return;
+    printf("Reservations: %lld booked, %lld rebooked (limit %d units per departure)\n",
+           bookings_made, bookings_rebooked, booking_limit);
+    if (board_wait_count[1] > 0)
+        printf("Reserved boarding wait: %.2f seconds average (%lld trips)\n",
+               board_wait_ns[1] / 1e9 / board_wait_count[1], board_wait_count[1]);
+}
+
+#define BENCH_THREADS 4
+
+typedef struct {
+    long long ops;
+    unsigned int seed;
+    long long made, failed, checksum;
+} BookingBench;
+
+// Reserve, lookup and cancel mix over a window that slides as departures leave
+void* booking_bench_thread(void* arg) {
+    BookingBench *b = (BookingBench*)arg;
+    unsigned int seed = b->seed;
+    long long *booked = malloc(sizeof(long long) * 4096);
+    int held = 0;
+
+    for (long long i = 0; i < b->ops; ++i) {
+        long long base = i >> 10;
+        int r = rand_r(&seed);
+        if (held == 4096 || (held > 0 && r % 4 == 0)) {
+            booking_cancel(booked[--held], 1);
+        } else if (r % 4 == 1) {
+            b->checksum += booking_units(base + r % BOOKING_WINDOW);
+        } else {
+            long long d = base + r % (BOOKING_WINDOW / 2);
+            if (booking_reserve(d, 1)) {
+                booked[held++] = d;
+                b->made++;
+            } else {
+                b->failed++;
+            }
+        }
+    }
+    free(booked);
+    return NULL;
+}
+
+// Measures booking engine throughput with BENCH_THREADS threads contending on the slots
+int booking_bench(long long ops) {
+    pthread_t threads[BENCH_THREADS];
+    BookingBench runs[BENCH_THREADS];
+    long long made = 0, failed = 0;
+
+    booking_limit = 1 << 20;
+    long long start = now_ns();
+    for (int i = 0; i < BENCH_THREADS; ++i) {
+        runs[i] = (BookingBench){ops / BENCH_THREADS, (unsigned int)time(NULL) + i, 0, 0, 0};
+        pthread_create(&threads[i], NULL, booking_bench_thread, &runs[i]);
+    }
+    for (int i = 0; i < BENCH_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        made += runs[i].made;
+        failed += runs[i].failed;
+    }
+    long long elapsed = now_ns() - start;
+    printf("Booking engine: %lld operations on %d threads in %.3f seconds, %.1f ns/op (%lld reserved, %lld rejected)\n",
+           ops, BENCH_THREADS, elapsed / 1e9, (double)elapsed / ops, made, failed);
+    return 0;
+}
+
+// Per-type table shared by the closed-mode analytics and the open-mode aggregates.
+// Arrays are indexed by VehicleType; pct[0] holds the percentiles over all types (seconds).
+void print_type_table(const long long count[4], const long long system_sum[4], const long long wait_sum[4],
+                      const long long system_max[4], const double pct[4][3], const unsigned long long *hist) {
+    long long total = 0, sys_total = 0, wait_total = 0, sys_max = 0;
+    for (int k = CAR; k <= TRUCK; ++k) {
+        total += count[k];
+        sys_total += system_sum[k];
+        wait_total += wait_sum[k];
+        if (system_max[k] > sys_max)
+            sys_max = system_max[k];
+    }
+    if (total == 0)
+        return;
+
+    printf("  %-8s %9s %10s %9s %9s %9s %9s %10s\n",
+           "Type", "Count", "Mean (s)", "p50", "p95", "p99", "Max", "Wait (s)");
+    for (int k = CAR; k <= TRUCK; ++k) {
+        long long n = count[k];
+        if (n == 0)
+            continue;
+        printf("  %-8s %9lld %10.2f %9.2f %9.2f %9.2f %9.2f %10.2f\n",
+               vehicle_type_str((VehicleType)k), n, system_sum[k] / 1e9 / n,
+               pct[k][0], pct[k][1], pct[k][2], system_max[k] / 1e9, wait_sum[k] / 1e9 / n);
+    }
+    printf("  %-8s %9lld %10.2f %9.2f %9.2f %9.2f %9.2f %10.2f\n",
+           "All", total, sys_total / 1e9 / total,
+           pct[0][0], pct[0][1], pct[0][2], sys_max / 1e9, wait_total / 1e9 / total);
+
+    // Histogram folded to one count per power of two seconds
+    printf("  System time histogram:");
+    unsigned long long octave = 0;
+    for (int bin = 0; bin < LATENCY_BINS; ++bin) {
+        octave += hist[bin];
+        double upper = latency_bin_upper_ms(bin);
+        if ((bin >= 8 && (bin - 8) % 4 == 3 && upper >= 1000) || bin == LATENCY_BINS - 1) {
+            if (octave > 0)
+                printf(" <=%.0fs:%llu", upper / 1000.0, octave);
+            octave = 0;
+        }
+    }
+    printf("\n");
+}
+
+// Partial aggregates over rows [begin, end), merged after the threads finish
+typedef struct {
+    const ResultTable *t;
+    long long begin, end;
+    long long count[4];
+    long long system_sum[4];
+    long long wait_sum[4];
+    long long system_max[4];
+    unsigned long long hist[LATENCY_BINS];
+} AnalyticsChunk;
+
+// Group-by over the type column with a mask instead of a branch or a scatter,
+// so each pass is a straight reduction the compiler can vectorize
+void *analytics_chunk(void *arg) {
+    AnalyticsChunk *c = (AnalyticsChunk*)arg;
+    const long long *type = c->t->type + c->begin;
+    const long long *sys = c->t->system_ns + c->begin;
+    const long long *wait = c->t->wait_ns + c->begin;
+    long long n = c->end - c->begin;
+
+    for (int k = CAR; k <= TRUCK; ++k) {
+        long long count = 0, sys_sum = 0, wait_sum = 0, sys_max = 0;
+        for (long long i = 0; i < n; ++i) {
+            long long mask = -(long long)(type[i] == k);
+            long long x = sys[i] & mask;
+            count += mask & 1;
+            sys_sum += x;
+            wait_sum += wait[i] & mask;
+            sys_max = x > sys_max ? x : sys_max;
+        }
+        c->count[k] = count;
+        c->system_sum[k] = sys_sum;
+        c->wait_sum[k] = wait_sum;
+        c->system_max[k] = sys_max;
+    }
+    for (long long i = 0; i < n; ++i) {
+        c->hist[latency_bin(sys[i])]++;
+    }
+    return NULL;
+}
+
+// Hoare-style selection: a[k] ends up holding the k-th smallest value
+long long select_kth(long long *a, long long n, long long k) {
+    long long lo = 0, hi = n - 1;
+    while (lo < hi) {
+        long long pivot = a[lo + (hi - lo) / 2];
+        long long i = lo, j = hi;
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) {
+                long long tmp = a[i];
+                a[i++] = a[j];
+                a[j--] = tmp;
+            }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else break;
+    }
+    return a[k];
+}
+
+// Exact percentile by nearest rank; reorders a
+long long column_percentile(long long *a, long long n, double q) {
+    if (n == 0)
+        return 0;
+    long long k = (long long)ceil(q * n) - 1;
+    return select_kth(a, n, k < 0 ? 0 : k);
+}
+
+// p50/p95/p99 of one contiguous group, in seconds
+typedef struct {
+    long long *values;
+    long long n;
+    double pct[3];
+} PercentileJob;
+
+void *percentile_job(void *arg) {
+    PercentileJob *job = (PercentileJob*)arg;
+    const double qs[3] = {0.50, 0.95, 0.99};
+    for (int q = 0; q < 3; ++q)
+        job->pct[q] = column_percentile(job->values, job->n, qs[q]) / 1e9;
+    return NULL;
+}
+
+// Writes the full per-vehicle table; the summary stays on stdout
+int results_write(const ResultTable *t, const char *path) {
+    FILE *f = results_open(path);
+    if (f == NULL)
+        return -1;
+    for (long long r = 0; r < t->rows; ++r) {
+        results_write_row(f, t->id[r], t->type[r], t->system_ns[r], t->wait_ns[r]);
+    }
+    return fclose(f);
+}
+
+// Sums, per-type group-by, exact percentiles and a histogram over the result columns.
+// Fills the overall averages (nanoseconds) for callers that print them separately.
+void results_analyze(const ResultTable *t, double *avg_system_ns, double *avg_wait_ns) {
+    AnalyticsChunk chunks[MAX_ANALYTICS_THREADS];
+    pthread_t threads[MAX_ANALYTICS_THREADS];
+    long long start = now_ns();
+
+    int nthreads = analytics_threads;
+    if (nthreads > t->rows / ANALYTICS_MIN_CHUNK)
+        nthreads = (int)(t->rows / ANALYTICS_MIN_CHUNK);
+    if (nthreads < 1)
+        nthreads = 1;
+    for (int i = 0; i < nthreads; ++i) {
+        memset(&chunks[i], 0, sizeof(chunks[i]));
+        chunks[i].t = t;
+        chunks[i].begin = t->rows * i / nthreads;
+        chunks[i].end = t->rows * (i + 1) / nthreads;
+        if (i > 0)
+            pthread_create(&threads[i], NULL, analytics_chunk, &chunks[i]);
+    }
+    analytics_chunk(&chunks[0]);
+    for (int i = 1; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+        AnalyticsChunk *c = &chunks[i];
+        for (int k = CAR; k <= TRUCK; ++k) {
+            chunks[0].count[k] += c->count[k];
+            chunks[0].system_sum[k] += c->system_sum[k];
+            chunks[0].wait_sum[k] += c->wait_sum[k];
+            if (c->system_max[k] > chunks[0].system_max[k])
+                chunks[0].system_max[k] = c->system_max[k];
+        }
+        for (int b = 0; b < LATENCY_BINS; ++b)
+            chunks[0].hist[b] += c->hist[b];
+    }
+    AnalyticsChunk *all = &chunks[0];
+
+    // Percentiles need each group contiguous: partition a copy of the system column by type
+    long long *sorted = malloc(sizeof(long long) * (t->rows > 0 ? t->rows : 1));
+    long long offset[5] = {0};
+    for (int k = CAR; k <= TRUCK; ++k)
+        offset[k + 1] = offset[k] + all->count[k];
+    long long fill[4];
+    memcpy(fill, offset, sizeof(fill));
+    for (long long r = 0; r < t->rows; ++r)
+        sorted[fill[t->type[r]]++] = t->system_ns[r];
+
+    // Exact percentiles per type (one thread each when allowed), then over all rows;
+    // job 0 covers the whole column and runs last because it reorders every group
+    PercentileJob pct[4];
+    long long total = offset[TRUCK + 1];
+    for (int k = CAR; k <= TRUCK; ++k) {
+        pct[k] = (PercentileJob){sorted + offset[k], all->count[k], {0}};
+        if (nthreads > 1)
+            pthread_create(&threads[k], NULL, percentile_job, &pct[k]);
+        else
+            percentile_job(&pct[k]);
+    }
+    for (int k = CAR; k <= TRUCK && nthreads > 1; ++k)
+        pthread_join(threads[k], NULL);
+    pct[0] = (PercentileJob){sorted, total, {0}};
+    percentile_job(&pct[0]);
+    free(sorted);
+    double elapsed_ms = (now_ns() - start) / 1e6;
+
+    long long sys_total = 0, wait_total = 0;
+    for (int k = CAR; k <= TRUCK; ++k) {
+        sys_total += all->system_sum[k];
+        wait_total += all->wait_sum[k];
+    }
+
+    printf("Vehicle results: %lld vehicles analyzed in %.1f ms on %d thread%s\n",
+           total, elapsed_ms, nthreads, nthreads == 1 ? "" : "s");
+    double pct_s[4][3];
+    for (int k = 0; k <= TRUCK; ++k)
+        memcpy(pct_s[k], pct[k].pct, sizeof(pct_s[k]));
+    print_type_table(all->count, all->system_sum, all->wait_sum, all->system_max, pct_s, all->hist);
+
+    if (avg_system_ns != NULL)
+        *avg_system_ns = total > 0 ? (double)sys_total / total : 0.0;
+    if (avg_wait_ns != NULL)
+        *avg_wait_ns = total > 0 ? (double)wait_total / total : 0.0;
+
+    if (results_path != NULL && results_write(t, results_path) == 0)
+        printf("  Per-vehicle table written to %s\n", results_path);
+}
+
+// Runs the analytics over N synthetic vehicles, as a large open run would produce
+int analytics_bench(long long rows) {
+    unsigned int seed = (unsigned int)time(NULL);
+    if (rows <= 0 || results_reserve(&results, rows) != 0) {
+        fprintf(stderr, "Cannot allocate %lld result rows\n", rows);
+        return -1;
+    }
+    for (long long r = 0; r < rows; ++r) {
+        // Skewed times: most trips take a minute or two, a few wait much longer
+        double u = (rand_r(&seed) + 1.0) / ((double)RAND_MAX + 2.0);
+        long long wait = (long long)(-log(u) * 40e9);
+        results.id[r] = r;
+        results.type[r] = CAR + rand_r(&seed) % 3;
+        results.wait_ns[r] = wait;
+        results.system_ns[r] = wait + 30000000000LL + rand_r(&seed) % 20000000000LL;
+    }
+    results.rows = rows;
+    results_analyze(&results, NULL, NULL);
+    return 0;
+}
+
+// Per-lane utilization and plaza throughput over the whole run
+void print_lane_stats(long long runtime_ns) {
+    printf("Toll lanes (%.0f%% tagged vehicles):\n", tag_share * 100);
+    for (int side = 0; side < 2; ++side) {
+        long long plaza_served = 0;
+        for (int lane = 0; lane < lane_count; ++lane) {
+            int idx = side * MAX_LANES + lane;
+            plaza_served += lane_served[idx];
+            printf("  Side %d lane %d (%-5s): %4lld served, utilization %5.1f%%, avg service %.2f seconds\n",
+                   side, lane, lane_kind_str(lanes[lane]), lane_served[idx],
+                   runtime_ns > 0 ? 100.0 * lane_busy_ns[idx] / runtime_ns : 0.0,
+                   lane_served[idx] > 0 ? lane_busy_ns[idx] / 1e9 / lane_served[idx] : 0.0);
+        }
+        printf("  Side %d plaza throughput: %.2f vehicles/minute\n", side,
+               runtime_ns > 0 ? plaza_served * 60e9 / runtime_ns : 0.0);
+    }
+}
+
+void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  --open                 Open system: continuous arrivals, one trip per vehicle\n"
+           "  --rate R               Mean arrivals per second (default %.2f)\n"
+           "  --profile-amp A        Relative arrival rate swing, 0..1 (default %.2f)\n"
+           "  --profile-period S     Arrival rate cycle length in seconds (default %.0f)\n"
+           "  --duration S           Arrival phase length in seconds, 0 = until Ctrl+C (default %.0f)\n"
+           "  --warmup S             Discard vehicles arriving in the first S seconds (default %.0f)\n"
+           "  --window S             Sliding statistics window in seconds (default %.0f)\n"
+           "  --report S             Seconds between window reports (default %.0f)\n"
+           "  --depart-timeout S     Max seconds the ferry waits at the dock, 0 = until full\n"
+           "                         (default 0, open mode 10)\n"
+           "  --sample-out FILE      Record queue depths to a delta-encoded columnar file\n"
+           "  --sample-ms MS         Sampling interval in milliseconds (default %d)\n"
+           "  --dump-samples FILE    Print a sample file as CSV and exit\n"
+           "  --lanes LIST           Toll lanes per side, comma-separated mixed/tag/heavy\n"
+           "                         (default mixed,mixed; at most %d, one must be mixed)\n"
+           "  --tag-share F          Fraction of vehicles with a pre-paid tag (default %.2f)\n"
+           "  --ramps N              Parallel loading ramps, 1..%d (default %d)\n"
+           "  --reserve-share F      Fraction of trips booked in advance (default %.2f)\n"
+           "  --reserve-cap F        Fraction of capacity open to bookings (default %.2f)\n"
+           "  --overbook F           Extra bookings beyond that share (default %.2f)\n"
+           "  --booking-bench N      Time N booking engine operations and exit\n"
+           "  --stall-timeout N      Seconds without progress before a stall dump, 0 = off (default %d)\n"
+           "  --stall-abort          Exit with status %d after a stall dump\n"
+           "  --results-out FILE     Write the per-vehicle result table as CSV\n"
+           "                         (open mode streams counted vehicles to it)\n"
+           "  --analytics-threads N  Threads for post-run analytics, 1..%d (default %d)\n"
+           "  --analytics-bench N    Analyze N synthetic vehicles and exit\n",
+           prog, open_cfg.arrival_rate, open_cfg.profile_amplitude, open_cfg.profile_period,
+           open_cfg.duration, open_cfg.warmup, open_cfg.window, open_cfg.report_interval,
+           sample_interval_ms, MAX_LANES, tag_share, MAX_RAMPS, ramp_count,
+           reserve_share, reserve_cap, overbook, stall_timeout, STALL_EXIT_CODE,
+           MAX_ANALYTICS_THREADS, analytics_threads);
+}
+
+int parse_lanes(const char *spec) {
+    char buf[64];
+    int mixed = 0;
+    snprintf(buf, sizeof(buf), "%s", spec);
+    lane_count = 0;
+    for (char *tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (lane_count == MAX_LANES) {
+            fprintf(stderr, "At most %d toll lanes per side\n", MAX_LANES);
+            return -1;
+        }
+        if (strcmp(tok, "mixed") == 0) lanes[lane_count] = LANE_MIXED;
+        else if (strcmp(tok, "tag") == 0) lanes[lane_count] = LANE_TAG;
+        else if (strcmp(tok, "heavy") == 0) lanes[lane_count] = LANE_HEAVY;
+        else {
+            fprintf(stderr, "Unknown lane kind: %s\n", tok);
+            return -1;
+        }
+        mixed |= lanes[lane_count++] == LANE_MIXED;
+    }
+    // Cash-paying cars can only use a mixed lane
+    if (!mixed) {
+        fprintf(stderr, "At least one toll lane must be mixed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int parse_args(int argc, char *argv[]) {
+    int timeout_given = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--open") == 0) {
+            open_cfg.enabled = 1;
+            continue;
+        }
+        if (strcmp(opt, "--stall-abort") == 0) {
+            stall_abort = 1;
+            continue;
+        }
+        if (strcmp(opt, "--help") == 0 || i + 1 >= argc) {
+            print_usage(argv[0]);
+            return -1;
+        }
+        if (strcmp(opt, "--sample-out") == 0) {
+            sample_path = argv[++i];
+            continue;
+        }
+        if (strcmp(opt, "--results-out") == 0) {
+            results_path = argv[++i];
+            continue;
+        }
+        if (strcmp(opt, "--lanes") == 0) {
+            if (parse_lanes(argv[++i]) != 0)
+                return -1;
+            continue;
+        }
+        // Tools that replace the simulation run after every option has been read
+        RunMode mode = strcmp(opt, "--analytics-bench") == 0 ? RUN_ANALYTICS_BENCH :
+                       strcmp(opt, "--booking-bench") == 0 ? RUN_BOOKING_BENCH :
+                       strcmp(opt, "--dump-samples") == 0 ? RUN_DUMP_SAMPLES : RUN_SIMULATION;
+        if (mode != RUN_SIMULATION) {
+            run_mode = mode;
+            run_mode_arg = argv[++i];
+            continue;
+        }
+        double value = atof(argv[++i]);
+        if (strcmp(opt, "--rate") == 0) open_cfg.arrival_rate = value;
+        else if (strcmp(opt, "--profile-amp") == 0) open_cfg.profile_amplitude = value;
+        else if (strcmp(opt, "--profile-period") == 0) open_cfg.profile_period = value;
+        else if (strcmp(opt, "--duration") == 0) open_cfg.duration = value;
+        else if (strcmp(opt, "--warmup") == 0) open_cfg.warmup = value;
+        else if (strcmp(opt, "--window") == 0) open_cfg.window = value;
+        else if (strcmp(opt, "--report") == 0) open_cfg.report_interval = value;
+        else if (strcmp(opt, "--sample-ms") == 0) sample_interval_ms = (int)value;
+        else if (strcmp(opt, "--tag-share") == 0) tag_share = value;
+        else if (strcmp(opt, "--ramps") == 0) ramp_count = (int)value;
+        else if (strcmp(opt, "--reserve-share") == 0) reserve_share = value;
+        else if (strcmp(opt, "--reserve-cap") == 0) reserve_cap = value;
+        else if (strcmp(opt, "--overbook") == 0) overbook = value;
+        else if (strcmp(opt, "--stall-timeout") == 0) stall_timeout = (int)value;
+        else if (strcmp(opt, "--analytics-threads") == 0) analytics_threads = (int)value;
+        else if (strcmp(opt, "--depart-timeout") == 0) {
+            departure_timeout = (int)value;
+            timeout_given = 1;
+        } else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    // Name the offending option; most of these apply to closed runs too
+    const char *bad = NULL, *range = NULL;
+    if (open_cfg.arrival_rate <= 0) bad = "--rate", range = "> 0";
+    else if (open_cfg.profile_amplitude < 0 || open_cfg.profile_amplitude > 1) bad = "--profile-amp", range = "0..1";
+    else if (open_cfg.profile_period <= 0) bad = "--profile-period", range = "> 0";
+    else if (open_cfg.window <= 0) bad = "--window", range = "> 0";
+    else if (open_cfg.report_interval <= 0) bad = "--report", range = "> 0";
+    else if (sample_interval_ms <= 0) bad = "--sample-ms", range = "> 0";
+    else if (tag_share < 0 || tag_share > 1) bad = "--tag-share", range = "0..1";
+    else if (ramp_count < 1 || ramp_count > MAX_RAMPS) bad = "--ramps", range = "1.." XSTR(MAX_RAMPS);
+    else if (reserve_share < 0 || reserve_share > 1) bad = "--reserve-share", range = "0..1";
+    else if (reserve_cap < 0 || reserve_cap > 1) bad = "--reserve-cap", range = "0..1";
+    else if (overbook < 0) bad = "--overbook", range = ">= 0";
+    else if (stall_timeout < 0) bad = "--stall-timeout", range = ">= 0";
+    else if (analytics_threads < 1 || analytics_threads > MAX_ANALYTICS_THREADS) bad = "--analytics-threads", range = "1.." XSTR(MAX_ANALYTICS_THREADS);
+    if (bad != NULL) {
+        fprintf(stderr, "Invalid value for %s (expected %s)\n", bad, range);
+        return -1;
+    }
+    // Overbooking can never promise more than a whole ferry
+    booking_limit = (int)(CAPACITY * reserve_cap * (1.0 + overbook) + 0.5);
+    if (booking_limit > CAPACITY)
+        booking_limit = CAPACITY;
+    // Without a timeout the last vehicles of an open run may never fill the ferry
+    if (open_cfg.enabled && !timeout_given)
+        departure_timeout = 10;
+    return 0;
 }
 
-int main() {
+int run_open_system() {
+    pthread_t fthread, athread, rthread, sthread, wthread, dthread;
+
+    pool_init();
+    bucket_width_ns = (long long)(open_cfg.window * 1e9) / WINDOW_BUCKETS;
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        window_buckets[i].epoch = -1;
+    }
+    signal(SIGINT, handle_sigint);
+
+    printf("Open system: %.2f arrivals/s", open_cfg.arrival_rate);
+    if (open_cfg.profile_amplitude > 0)
+        printf(" (+/-%.0f%% over %.0fs)", open_cfg.profile_amplitude * 100, open_cfg.profile_period);
+    if (open_cfg.duration > 0)
+        printf(", arrivals for %.0fs", open_cfg.duration);
+    else
+        printf(", running until Ctrl+C");
+    printf(", warm-up %.0fs, window %.0fs\n\n", open_cfg.warmup, open_cfg.window);
+
+    // Per-vehicle rows are streamed, so memory stays bounded however long the run
+    if (results_path != NULL && (results_file = results_open(results_path)) == NULL)
+        return EXIT_FAILURE;
+
+    clock_gettime(CLOCK_MONOTONIC, &simulation_start_time);
+    pthread_mutex_lock(&start_mutex);
+    start_signal_given = 1;
+    pthread_mutex_unlock(&start_mutex);
+
+    if (sample_path != NULL && sampler_start(&sthread, &wthread) != 0)
+        return EXIT_FAILURE;
+    watchdog_start(&dthread);
+    pthread_create(&fthread, NULL, ferry_thread, NULL);
+    pthread_create(&rthread, NULL, reporter_thread, NULL);
+    pthread_create(&athread, NULL, arrival_thread, NULL);
+
+    pthread_join(athread, NULL);
+    pthread_join(fthread, NULL);
+    watchdog_stop(dthread);
+    if (sample_path != NULL)
+        sampler_stop(sthread, wthread);
+
+    pthread_mutex_lock(&stats_mutex);
+    reporter_done = 1;
+    pthread_mutex_unlock(&stats_mutex);
+    pthread_join(rthread, NULL);
+
+    cleanup_named_semaphores();
+
+    stats_report_window();
+
+    printf("\n--- Open System Results (after %.0fs warm-up) ---\n", open_cfg.warmup);
+    long long total_sim_duration_ns = (simulation_end_time.tv_sec - simulation_start_time.tv_sec) * 1000000000LL +
+                                      (simulation_end_time.tv_nsec - simulation_start_time.tv_nsec);
+    printf("Total simulation runtime: %.4f seconds\n", (double)total_sim_duration_ns / 1000000000.0);
+    printf("Vehicles served: %d, counted: %lld, discarded as warm-up: %lld, rejected: %lld\n",
+           next_vehicle_id, stats_completed, stats_warmup_discarded, stats_rejected);
+    printf("Ferry crossings: %d\n", total_ferry_crossings);
+    print_lane_stats(total_sim_duration_ns);
+    print_dwell_stats();
+    print_reservation_stats(total_sim_duration_ns);
+    if (stats_completed > 0) {
+        printf("Average time vehicles spent in system: %.4f seconds\n",
+               (double)stats_latency_sum_ns / stats_completed / 1000000000.0);
+
+        // Same table as closed mode, but percentiles come from the bounded histograms
+        const double qs[3] = {0.50, 0.95, 0.99};
+        double pct[4][3];
+        for (int k = 0; k <= TRUCK; ++k) {
+            const unsigned long long *hist = k == 0 ? stats_latency_hist : stats_type_hist[k];
+            long long n = k == 0 ? stats_completed : stats_type_count[k];
+            long long max_ns = 0;
+            for (int t = CAR; t <= TRUCK; ++t) {
+                if ((k == 0 || t == k) && stats_type_system_max_ns[t] > max_ns)
+                    max_ns = stats_type_system_max_ns[t];
+            }
+            // A bin's upper bound can lie past the largest value seen
+            for (int q = 0; q < 3; ++q)
+                pct[k][q] = fmin(hist_percentile_ms(hist, n, qs[q]) / 1000.0, max_ns / 1e9);
+        }
+        printf("Vehicle results by type (histogram percentiles):\n");
+        print_type_table(stats_type_count, stats_type_system_sum_ns, stats_type_wait_sum_ns,
+                         stats_type_system_max_ns, pct, stats_latency_hist);
+    }
+    if (results_file != NULL) {
+        fclose(results_file);
+        printf("Per-vehicle table written to %s\n", results_path);
+    }
+    printf("----------------------------------\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
     srand(time(NULL));
     pthread_t vthreads[TOTAL_VEHICLES];
-    pthread_t fthread;
+    pthread_t fthread, sthread, wthread, dthread;
+
+    if (parse_args(argc, argv) != 0)
+        return EXIT_FAILURE;
+    switch (run_mode) {
+        case RUN_ANALYTICS_BENCH:
+            return analytics_bench(atoll(run_mode_arg)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        case RUN_BOOKING_BENCH:
+            return booking_bench(atoll(run_mode_arg)) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        case RUN_DUMP_SAMPLES:
+            return dump_samples(run_mode_arg) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        default:
+            break;
+    }
 
     init_named_semaphores();
 
     ferry_side = rand() % 2;
+    initial_ferry_side = ferry_side;
     printf("Ferry starting side: %d\n\n", ferry_side);
 
+    if (open_cfg.enabled)
+        return run_open_system();
+
     int id = 0;
     for (int i = 0; i < TOTAL_CARS; ++i, ++id) {
         vehicles[id] = (Vehicle){id, CAR, rand() % 2, rand() % 2, 0, {0,0}, {0,0}, 0LL};
@@ -271,8 +2263,20 @@ int main() {
     for (int i = 0; i < TOTAL_TRUCKS; ++i, ++id) {
         vehicles[id] = (Vehicle){id, TRUCK, rand() % 2, rand() % 2, 0, {0,0}, {0,0}, 0LL};
     }
-    
-    // Start the ferry thread (to record simulation start time)
+    for (int i = 0; i < TOTAL_VEHICLES; ++i) {
+        vehicles[i].has_tag = rand() < tag_share * RAND_MAX;
+    }
+    vehicles_in_system = TOTAL_VEHICLES;
+    if (results_reserve(&results, TOTAL_VEHICLES) != 0) {
+        fprintf(stderr, "Cannot allocate the result table for %d vehicles\n", TOTAL_VEHICLES);
+        return EXIT_FAILURE;
+    }
+
+    // Record the simulation start time, then start the sampler and the ferry thread
+    clock_gettime(CLOCK_MONOTONIC, &simulation_start_time);
+    if (sample_path != NULL && sampler_start(&sthread, &wthread) != 0)
+        return EXIT_FAILURE;
+    watchdog_start(&dthread);
     pthread_create(&fthread, NULL, ferry_thread, NULL);
 
     // Start vehicle threads
@@ -291,43 +2295,37 @@ int main() {
     }
 
     pthread_join(fthread, NULL);
+    watchdog_stop(dthread);
+    if (sample_path != NULL)
+        sampler_stop(sthread, wthread);
 
     cleanup_named_semaphores();
 
     printf("\n--- Simulation Results ---\n");
 
-    // Individual vehicle system times
-    long long total_system_time_sum = 0;
-    for (int i = 0; i < TOTAL_VEHICLES; ++i) {
-        long long vehicle_duration_ns = (vehicles[i].end_time.tv_sec - vehicles[i].start_time.tv_sec) * 1000000000LL +
-                                        (vehicles[i].end_time.tv_nsec - vehicles[i].start_time.tv_nsec);
-        total_system_time_sum += vehicle_duration_ns;
-        printf("Vehicle %d (%s) total time in system: %.4f seconds\n",
-               vehicles[i].id, vehicle_type_str(vehicles[i].type), (double)vehicle_duration_ns / 1000000000.0);
-    }
-
-    // Individual vehicle waiting times
-    long long total_wait_time_sum = 0;
+    // Per-vehicle times go into the result columns; only the summary is printed
+    double average_system_time_ns = 0, average_wait_time_ns = 0;
     for (int i = 0; i < TOTAL_VEHICLES; ++i) {
-        total_wait_time_sum += vehicles[i].total_wait_time;
-        printf("Vehicle %d (%s) total waiting time: %.4f seconds\n", vehicles[i].id, 
-               vehicle_type_str(vehicles[i].type), (double)vehicles[i].total_wait_time / 1000000000.0);
+        results_append(&results, &vehicles[i],
+                       timespec_to_ns(vehicles[i].end_time) - timespec_to_ns(vehicles[i].start_time));
     }
+    results_analyze(&results, &average_system_time_ns, &average_wait_time_ns);
     printf("----------------------------------\n");
 
     // Total simulation runtime
     long long total_sim_duration_ns = (simulation_end_time.tv_sec - simulation_start_time.tv_sec) * 1000000000LL +
                                       (simulation_end_time.tv_nsec - simulation_start_time.tv_nsec);
     printf("Total simulation runtime: %.4f seconds\n", (double)total_sim_duration_ns / 1000000000.0);
+    print_lane_stats(total_sim_duration_ns);
+    print_dwell_stats();
+    print_reservation_stats(total_sim_duration_ns);
     // Average time vehicles spent in the system
     if (TOTAL_VEHICLES > 0) {
-        double average_system_time = (double)total_system_time_sum / TOTAL_VEHICLES / 1000000000.0;
-        printf("Average time vehicles spent in system: %.4f seconds\n", average_system_time);
+        printf("Average time vehicles spent in system: %.4f seconds\n", average_system_time_ns / 1000000000.0);
     }
     // Average waiting time for all vehicles
     if (TOTAL_VEHICLES > 0) {
-        double average_total_wait_time = (double)total_wait_time_sum / TOTAL_VEHICLES / 1000000000.0;
-        printf("Average waiting time for all vehicles: %.4f seconds\n", average_total_wait_time);
+        printf("Average waiting time for all vehicles: %.4f seconds\n", average_wait_time_ns / 1000000000.0);
     }
     printf("----------------------------------\n");
 
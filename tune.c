@@ -0,0 +1,834 @@
+// Autotuner for the ferry system's operational parameters.
+//
+// Candidates (gates per side, square size, ferry capacity, loading ramps, departure
+// timeout and, optionally, fleet mix) are scored on a virtual-time, discrete-event
+// model of the same system new2 simulates with threads: toll lanes picked by shortest
+// eligible queue with cash/tag service classes per vehicle type (+/-25%), square
+// settle 3s, crossing 4s, docking 1s, per-type ramp times with boarding order on
+// and last on, first off, Poisson arrivals, one trip per vehicle.
+//
+// Search runs in brackets of successive halving: every candidate gets a short
+// simulated run, the better half gets twice the budget, and so on. Unstable
+// candidates (runaway backlog) are stopped early. After the first bracket, half of
+// the new candidates are drawn around the current elite set instead of uniformly.
+// All configurations evaluated at full budget form the Pareto front of
+// (objective, crossings per hour).
+//
+// Build: gcc -O2 -pthread tune.c -o tune -lm
+// Run:   ./tune [--rate R] [--objective p95|mean] [--max-crossings K] [--hours H]
+//               [--brackets B] [--candidates N] [--jobs J] [--tune-mix] [--csv FILE]
+//               [--lanes LIST] [--tag-share F]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <string.h>
+#include <math.h>
+
+#define SETTLE_TIME 3.0
+#define CROSSING_TIME 4.0
+#define DOCKING_TIME 1.0
+#define MAX_GATES 4
+#define MAX_RAMPS 4
+#define MAX_CANDIDATES 4096
+#define BACKLOG_LIMIT 2000      // Vehicles in system that mark a candidate unstable
+
+typedef enum { CAR = 1, MINIBUS = 2, TRUCK = 3 } VehicleType;
+typedef enum { LANE_MIXED, LANE_TAG, LANE_HEAVY } LaneKind;
+
+// Mean toll service time in seconds, [has_tag][type], as in new2
+const double toll_service[2][4] = {
+    {0, 3.0, 4.0, 6.0},     // Cash
+    {0, 0.3, 0.5, 1.5}      // Electronic tag
+};
+
+// Ramp transfer time in seconds by vehicle type, as in new2
+const double load_time[4] = {0, 2.0, 3.0, 5.0};
+const double unload_time[4] = {0, 1.5, 2.5, 4.0};
+
+typedef struct {
+    int gates;                  // Toll gates per side
+    int square;                 // Holding area slots per side
+    int capacity;               // Ferry capacity in units (car 1, minibus 2, truck 3)
+    int ramps;                  // Parallel loading ramps
+    double timeout;             // Seconds the ferry waits at the dock (0 = until full)
+    double mix[3];              // Fraction of cars, minibuses, trucks
+} Params;
+
+typedef struct {
+    double evaluated;           // Simulated hours of the latest evaluation
+    int unstable;
+    long long completed;
+    double p95;                 // Seconds, includes vehicles still in the system
+    double mean;
+    double throughput;          // Vehicles per hour
+    double crossings_per_hour;
+    double score;               // Lower is better
+} Result;
+
+typedef struct {
+    Params params;
+    Result result;
+} Candidate;
+
+// Tuner settings (set from the command line)
+double arrival_rate = 0.5;
+double max_hours = 8.0;
+double min_hours = 0.5;
+double warmup = 600.0;
+double max_crossings = 0;       // Per hour, 0 = unconstrained
+int use_p95 = 1;
+int brackets = 4;
+int bracket_size = 32;
+int jobs = 0;
+int tune_mix = 0;
+unsigned int base_seed = 12345;
+const char *csv_path = NULL;
+double default_mix[3] = {12.0 / 30, 10.0 / 30, 8.0 / 30};
+double tag_share = 0.0;         // Fraction of vehicles with a pre-paid tag
+LaneKind lane_layout[MAX_GATES] = {LANE_MIXED, LANE_MIXED, LANE_MIXED, LANE_MIXED};
+
+// ---------------------------------------------------------------------------
+// Discrete-event model
+
+typedef enum { EV_ARRIVAL, EV_TOLL_DONE, EV_SETTLED, EV_READY, EV_TIMEOUT, EV_DEPART, EV_ARRIVE } EventType;
+
+typedef struct {
+    double time;
+    long seq;
+    EventType type;
+    int side;
+    int arg;                    // Gate, vehicle or timeout token
+} Event;
+
+typedef struct {
+    double arrival;
+    int type;
+    int side;
+    int gate;
+    int has_tag;
+    int done;
+} SimVehicle;
+
+// Growable FIFO of vehicle indices
+typedef struct {
+    int *items;
+    int head, tail, cap;
+} Queue;
+
+typedef struct {
+    Params p;
+    unsigned int seed;
+    double now, horizon;
+    long seq;
+
+    Event *heap;
+    int heap_len, heap_cap;
+
+    SimVehicle *vehicles;
+    int vehicle_len, vehicle_cap;
+
+    Queue gate_queue[2][MAX_GATES];
+    int gate_busy[2][MAX_GATES];
+    Queue square_queue[2];
+    int square_used[2];
+    Queue board_list[2];        // Settled vehicles waiting for the ferry
+    int pending[2];             // Vehicles at the toll or in the square, not yet settled
+
+    int ferry_side, ferry_load, ferry_docked, ferry_ready, ferry_closing, timeout_token;
+    double ramp_free[MAX_RAMPS];  // Time each ramp becomes free
+    double last_ramp_start;       // Ramps are taken in manifest order
+    double loaded_at;             // Time the last boarded vehicle is on board
+    int *on_board;
+    int on_board_len;
+    int in_system;
+    long long crossings;
+
+    double *latencies;
+    long long latency_len, latency_cap;
+} Sim;
+
+void queue_push(Queue *q, int v) {
+    if (q->tail == q->cap) {
+        if (q->head > 0) {
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(int));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail == q->cap) {
+            q->cap = q->cap ? q->cap * 2 : 16;
+            q->items = realloc(q->items, q->cap * sizeof(int));
+        }
+    }
+    q->items[q->tail++] = v;
+}
+
+int queue_len(const Queue *q) {
+    return q->tail - q->head;
+}
+
+int queue_pop(Queue *q) {
+    return q->items[q->head++];
+}
+
+void schedule(Sim *s, double delay, EventType type, int side, int arg) {
+    if (s->heap_len == s->heap_cap) {
+        s->heap_cap = s->heap_cap ? s->heap_cap * 2 : 64;
+        s->heap = realloc(s->heap, s->heap_cap * sizeof(Event));
+    }
+    Event e = {s->now + delay, s->seq++, type, side, arg};
+    int i = s->heap_len++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        Event *pe = &s->heap[parent];
+        if (pe->time < e.time || (pe->time == e.time && pe->seq < e.seq))
+            break;
+        s->heap[i] = *pe;
+        i = parent;
+    }
+    s->heap[i] = e;
+}
+
+Event next_event(Sim *s) {
+    Event top = s->heap[0];
+    Event last = s->heap[--s->heap_len];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= s->heap_len)
+            break;
+        if (child + 1 < s->heap_len &&
+            (s->heap[child + 1].time < s->heap[child].time ||
+             (s->heap[child + 1].time == s->heap[child].time && s->heap[child + 1].seq < s->heap[child].seq)))
+            child++;
+        if (last.time < s->heap[child].time ||
+            (last.time == s->heap[child].time && last.seq < s->heap[child].seq))
+            break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    s->heap[i] = last;
+    return top;
+}
+
+double uniform01(unsigned int *seed) {
+    return (rand_r(seed) + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+void record_latency(Sim *s, double latency) {
+    if (s->latency_len == s->latency_cap) {
+        s->latency_cap = s->latency_cap ? s->latency_cap * 2 : 1024;
+        s->latencies = realloc(s->latencies, s->latency_cap * sizeof(double));
+    }
+    s->latencies[s->latency_len++] = latency;
+}
+
+int lane_accepts(LaneKind kind, const SimVehicle *v) {
+    switch (kind) {
+        case LANE_TAG: return v->has_tag;
+        case LANE_HEAVY: return v->type != CAR;
+        default: return 1;
+    }
+}
+
+// Eligible lane with the fewest vehicles queued or in service, ties at random
+int choose_gate(Sim *s, const SimVehicle *v) {
+    int best = -1, best_len = 0, ties = 0;
+    for (int g = 0; g < s->p.gates; ++g) {
+        if (!lane_accepts(lane_layout[g], v))
+            continue;
+        int len = queue_len(&s->gate_queue[v->side][g]) + s->gate_busy[v->side][g];
+        if (best < 0 || len < best_len) {
+            best = g;
+            best_len = len;
+            ties = 1;
+        } else if (len == best_len && rand_r(&s->seed) % ++ties == 0) {
+            best = g;
+        }
+    }
+    return best;
+}
+
+double toll_time(Sim *s, const SimVehicle *v) {
+    return toll_service[v->has_tag][v->type] * (0.75 + 0.5 * uniform01(&s->seed));
+}
+
+void start_settle(Sim *s, int side, int v) {
+    s->square_used[side]++;
+    schedule(s, SETTLE_TIME, EV_SETTLED, side, v);
+}
+
+// Books the earliest ramp for a transfer that may not start before the previous one
+double ramp_slot(Sim *s, double duration) {
+    int best = 0;
+    for (int r = 1; r < s->p.ramps; ++r) {
+        if (s->ramp_free[r] < s->ramp_free[best])
+            best = r;
+    }
+    double start = s->ramp_free[best];
+    if (start < s->last_ramp_start)
+        start = s->last_ramp_start;
+    if (start < s->now)
+        start = s->now;
+    s->last_ramp_start = start;
+    s->ramp_free[best] = start + duration;
+    return start + duration;
+}
+
+// Closes boarding; the ferry leaves once the vehicles on the ramps are aboard
+void depart(Sim *s) {
+    s->ferry_closing = 1;
+    s->ferry_ready = 0;
+    s->timeout_token++;
+    schedule(s, s->loaded_at > s->now ? s->loaded_at - s->now : 0, EV_DEPART, s->ferry_side, 0);
+}
+
+// Boards every settled vehicle that fits, then applies the departure rule
+void try_board(Sim *s) {
+    if (!s->ferry_docked || s->ferry_closing)
+        return;
+    int side = s->ferry_side;
+    Queue *q = &s->board_list[side];
+    int kept = q->head;
+    for (int i = q->head; i < q->tail; ++i) {
+        int v = q->items[i];
+        if (s->ferry_load + s->vehicles[v].type <= s->p.capacity) {
+            s->ferry_load += s->vehicles[v].type;
+            s->on_board[s->on_board_len++] = v;
+            double end = ramp_slot(s, load_time[s->vehicles[v].type]);
+            if (end > s->loaded_at)
+                s->loaded_at = end;
+            s->square_used[side]--;
+            if (queue_len(&s->square_queue[side]) > 0)
+                start_settle(s, side, queue_pop(&s->square_queue[side]));
+        } else {
+            q->items[kept++] = v;
+        }
+    }
+    q->tail = kept;
+
+    if (!s->ferry_ready)
+        return;
+    // Whatever is still in the board list did not fit, so only unsettled vehicles count
+    if (s->ferry_load >= s->p.capacity)
+        depart(s);
+    else if (s->pending[side] == 0 && (s->ferry_load > 0 || s->in_system > 0))
+        depart(s);
+}
+
+void handle_event(Sim *s, Event e) {
+    int side = e.side;
+    switch (e.type) {
+        case EV_ARRIVAL: {
+            if (s->vehicle_len == s->vehicle_cap) {
+                s->vehicle_cap = s->vehicle_cap ? s->vehicle_cap * 2 : 1024;
+                s->vehicles = realloc(s->vehicles, s->vehicle_cap * sizeof(SimVehicle));
+            }
+            int v = s->vehicle_len++;
+            double r = uniform01(&s->seed);
+            int type = r < s->p.mix[0] ? CAR : r < s->p.mix[0] + s->p.mix[1] ? MINIBUS : TRUCK;
+            side = rand_r(&s->seed) % 2;
+            s->vehicles[v] = (SimVehicle){s->now, type, side, 0, uniform01(&s->seed) < tag_share, 0};
+            int gate = choose_gate(s, &s->vehicles[v]);
+            s->vehicles[v].gate = gate;
+            s->pending[side]++;
+            s->in_system++;
+            if (s->gate_busy[side][gate]) {
+                queue_push(&s->gate_queue[side][gate], v);
+            } else {
+                s->gate_busy[side][gate] = 1;
+                schedule(s, toll_time(s, &s->vehicles[v]), EV_TOLL_DONE, side, v);
+            }
+            schedule(s, -log(uniform01(&s->seed)) / arrival_rate, EV_ARRIVAL, 0, 0);
+            // An idle ferry leaves for the other side when demand appears there
+            try_board(s);
+            break;
+        }
+        case EV_TOLL_DONE: {
+            int gate = s->vehicles[e.arg].gate;
+            Queue *gq = &s->gate_queue[side][gate];
+            if (queue_len(gq) > 0) {
+                int next = queue_pop(gq);
+                schedule(s, toll_time(s, &s->vehicles[next]), EV_TOLL_DONE, side, next);
+            } else
+                s->gate_busy[side][gate] = 0;
+            if (s->square_used[side] < s->p.square)
+                start_settle(s, side, e.arg);
+            else
+                queue_push(&s->square_queue[side], e.arg);
+            break;
+        }
+        case EV_SETTLED:
+            s->pending[side]--;
+            queue_push(&s->board_list[side], e.arg);
+            try_board(s);
+            break;
+        case EV_DEPART:
+            s->ferry_docked = 0;
+            s->crossings++;
+            schedule(s, CROSSING_TIME, EV_ARRIVE, 1 - side, 0);
+            break;
+        case EV_ARRIVE: {
+            // Unloading runs last on, first off; the dwell follows from the manifest
+            s->ferry_side = side;
+            for (int r = 0; r < MAX_RAMPS; ++r) {
+                s->ramp_free[r] = s->now + DOCKING_TIME;
+            }
+            s->last_ramp_start = 0;
+            double unloaded_at = s->now + DOCKING_TIME;
+            for (int i = s->on_board_len - 1; i >= 0; --i) {
+                SimVehicle *v = &s->vehicles[s->on_board[i]];
+                double end = ramp_slot(s, unload_time[v->type]);
+                if (end > unloaded_at)
+                    unloaded_at = end;
+                v->done = 1;
+                if (v->arrival >= warmup)
+                    record_latency(s, end - v->arrival);
+                s->in_system--;
+            }
+            s->on_board_len = 0;
+            s->ferry_load = 0;
+            schedule(s, unloaded_at - s->now, EV_READY, side, 0);
+            break;
+        }
+        case EV_READY:
+            s->ferry_docked = 1;
+            s->ferry_closing = 0;
+            s->last_ramp_start = 0;
+            s->loaded_at = 0;
+            s->ferry_ready = 1;
+            if (s->p.timeout > 0)
+                schedule(s, s->p.timeout, EV_TIMEOUT, side, s->timeout_token);
+            try_board(s);
+            break;
+        case EV_TIMEOUT:
+            if (s->ferry_ready && e.arg == s->timeout_token && (s->ferry_load > 0 || s->in_system > 0))
+                depart(s);
+            break;
+    }
+}
+
+int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void sim_free(Sim *s) {
+    for (int side = 0; side < 2; ++side) {
+        for (int g = 0; g < MAX_GATES; ++g) {
+            free(s->gate_queue[side][g].items);
+        }
+        free(s->square_queue[side].items);
+        free(s->board_list[side].items);
+    }
+    free(s->heap);
+    free(s->vehicles);
+    free(s->on_board);
+    free(s->latencies);
+}
+
+// Runs one virtual-time instance for the given number of simulated hours
+Result simulate(const Params *p, double hours, unsigned int seed) {
+    Sim s;
+    memset(&s, 0, sizeof(s));
+    s.p = *p;
+    s.seed = seed;
+    s.horizon = warmup + hours * 3600.0;
+    s.on_board = malloc((p->capacity + 1) * sizeof(int));
+    s.ferry_side = rand_r(&s.seed) % 2;
+    s.ferry_docked = 1;
+    s.ferry_ready = 1;
+
+    Result r;
+    memset(&r, 0, sizeof(r));
+    schedule(&s, -log(uniform01(&s.seed)) / arrival_rate, EV_ARRIVAL, 0, 0);
+    long long crossings_at_warmup = -1;
+    while (s.heap_len > 0) {
+        Event e = next_event(&s);
+        if (e.time > s.horizon)
+            break;
+        if (crossings_at_warmup < 0 && e.time >= warmup)
+            crossings_at_warmup = s.crossings;
+        s.now = e.time;
+        handle_event(&s, e);
+        if (s.in_system > BACKLOG_LIMIT) {
+            r.unstable = 1;
+            break;
+        }
+    }
+    if (crossings_at_warmup < 0)
+        crossings_at_warmup = 0;
+
+    r.completed = s.latency_len;
+    double measured = s.now - warmup > 1 ? s.now - warmup : 1;
+    r.throughput = r.completed / measured * 3600.0;
+    r.crossings_per_hour = (s.crossings - crossings_at_warmup) / measured * 3600.0;
+
+    // Vehicles still in the system count with their age so far
+    for (int i = 0; i < s.vehicle_len; ++i) {
+        SimVehicle *v = &s.vehicles[i];
+        if (!v->done && v->arrival >= warmup)
+            record_latency(&s, s.now - v->arrival);
+    }
+    double sum = 0;
+    for (long long i = 0; i < s.latency_len; ++i) {
+        sum += s.latencies[i];
+    }
+    r.mean = s.latency_len > 0 ? sum / s.latency_len : 0;
+    if (s.latency_len > 0) {
+        qsort(s.latencies, s.latency_len, sizeof(double), compare_double);
+        r.p95 = s.latencies[(long long)(0.95 * (s.latency_len - 1))];
+    }
+    sim_free(&s);
+    return r;
+}
+
+// ---------------------------------------------------------------------------
+// Search
+
+Candidate candidates[MAX_CANDIDATES];
+int candidate_count = 0;
+
+// Work shared by the evaluation threads
+int *work_items;
+int work_len;
+int work_next;
+double work_hours;
+unsigned int work_seed;
+pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+double score_of(const Result *r) {
+    if (r->unstable || r->completed == 0)
+        return 2e9;
+    if (max_crossings > 0 && r->crossings_per_hour > max_crossings)
+        return 1e9 + r->crossings_per_hour;
+    return use_p95 ? r->p95 : r->mean;
+}
+
+void *eval_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&work_mutex);
+        int i = work_next < work_len ? work_items[work_next++] : -1;
+        pthread_mutex_unlock(&work_mutex);
+        if (i < 0)
+            break;
+        // Same seed for every candidate of a round (common random numbers)
+        Candidate *c = &candidates[i];
+        c->result = simulate(&c->params, work_hours, work_seed);
+        c->result.evaluated = work_hours;
+        c->result.score = score_of(&c->result);
+    }
+    return NULL;
+}
+
+void evaluate(int *items, int n, double hours, unsigned int seed) {
+    pthread_t tids[256];
+    int threads = jobs < n ? jobs : n;
+    work_items = items;
+    work_len = n;
+    work_next = 0;
+    work_hours = hours;
+    work_seed = seed;
+    for (int t = 0; t < threads; ++t) {
+        pthread_create(&tids[t], NULL, eval_worker, NULL);
+    }
+    for (int t = 0; t < threads; ++t) {
+        pthread_join(tids[t], NULL);
+    }
+}
+
+int clamp_int(int v, int lo, int hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+double clamp_double(double v, double lo, double hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+double gaussian(unsigned int *seed) {
+    return sqrt(-2.0 * log(uniform01(seed))) * cos(2.0 * M_PI * uniform01(seed));
+}
+
+void random_mix(double mix[3], unsigned int *seed) {
+    double total = 0;
+    for (int k = 0; k < 3; ++k) {
+        mix[k] = 0.05 + uniform01(seed);
+        total += mix[k];
+    }
+    for (int k = 0; k < 3; ++k) {
+        mix[k] /= total;
+    }
+}
+
+Params random_params(unsigned int *seed) {
+    Params p;
+    p.gates = 1 + rand_r(seed) % MAX_GATES;
+    p.square = 5 + rand_r(seed) % 56;
+    p.capacity = 10 + rand_r(seed) % 31;
+    p.ramps = 1 + rand_r(seed) % MAX_RAMPS;
+    p.timeout = rand_r(seed) % 4 == 0 ? 0 : 60.0 * uniform01(seed);
+    memcpy(p.mix, default_mix, sizeof(p.mix));
+    if (tune_mix)
+        random_mix(p.mix, seed);
+    return p;
+}
+
+// Samples a neighbour of a good configuration
+Params perturb_params(const Params *base, unsigned int *seed) {
+    Params p = *base;
+    p.gates = clamp_int(p.gates + (int)lround(gaussian(seed) * 0.7), 1, MAX_GATES);
+    p.square = clamp_int(p.square + (int)lround(gaussian(seed) * 6), 5, 60);
+    p.capacity = clamp_int(p.capacity + (int)lround(gaussian(seed) * 3), 10, 40);
+    p.ramps = clamp_int(p.ramps + (int)lround(gaussian(seed) * 0.7), 1, MAX_RAMPS);
+    if (p.timeout == 0 && rand_r(seed) % 2)
+        p.timeout = 30.0 * uniform01(seed);
+    else if (p.timeout > 0)
+        p.timeout = rand_r(seed) % 8 == 0 ? 0 : clamp_double(p.timeout + gaussian(seed) * 6, 1, 60);
+    if (tune_mix) {
+        double total = 0;
+        for (int k = 0; k < 3; ++k) {
+            p.mix[k] = clamp_double(p.mix[k] + gaussian(seed) * 0.05, 0.02, 1);
+            total += p.mix[k];
+        }
+        for (int k = 0; k < 3; ++k) {
+            p.mix[k] /= total;
+        }
+    }
+    return p;
+}
+
+int compare_by_score(const void *a, const void *b) {
+    double x = candidates[*(const int *)a].result.score, y = candidates[*(const int *)b].result.score;
+    return (x > y) - (x < y);
+}
+
+// Indices of candidates that completed the full budget, best first
+int finalists(int *out) {
+    int n = 0;
+    for (int i = 0; i < candidate_count; ++i) {
+        if (candidates[i].result.evaluated >= max_hours)
+            out[n++] = i;
+    }
+    qsort(out, n, sizeof(int), compare_by_score);
+    return n;
+}
+
+void run_bracket(int bracket, unsigned int *seed) {
+    static int elite[MAX_CANDIDATES];
+    int elite_len = finalists(elite);
+    if (elite_len > 8)
+        elite_len = 8;
+
+    int items[MAX_CANDIDATES];
+    int n = 0;
+    for (int k = 0; k < bracket_size && candidate_count < MAX_CANDIDATES; ++k) {
+        Candidate *c = &candidates[candidate_count];
+        memset(c, 0, sizeof(*c));
+        if (elite_len > 0 && k % 2 == 0)
+            c->params = perturb_params(&candidates[elite[rand_r(seed) % elite_len]].params, seed);
+        else
+            c->params = random_params(seed);
+        items[n++] = candidate_count++;
+    }
+
+    double hours = min_hours;
+    for (int round = 0; n > 0; ++round) {
+        if (hours > max_hours)
+            hours = max_hours;
+        evaluate(items, n, hours, base_seed + round);
+        qsort(items, n, sizeof(int), compare_by_score);
+
+        // Unstable or constraint-violating candidates are dropped right away
+        int kept = 0;
+        while (kept < n && candidates[items[kept]].result.score < 1e9)
+            kept++;
+        fprintf(stderr, "Bracket %d round %d: %3d candidates x %5.1fh, best %s %.1fs, %d dropped\n",
+                bracket, round, n, hours, use_p95 ? "p95" : "mean",
+                kept > 0 ? candidates[items[0]].result.score : 0.0, n - kept);
+        if (hours >= max_hours)
+            break;
+        n = kept > 1 ? (kept + 1) / 2 : kept;
+        hours *= 2;
+    }
+}
+
+int dominates(const Result *a, const Result *b) {
+    double oa = use_p95 ? a->p95 : a->mean, ob = use_p95 ? b->p95 : b->mean;
+    return oa <= ob && a->crossings_per_hour <= b->crossings_per_hour &&
+           (oa < ob || a->crossings_per_hour < b->crossings_per_hour);
+}
+
+int compare_by_crossings(const void *a, const void *b) {
+    double x = candidates[*(const int *)a].result.crossings_per_hour;
+    double y = candidates[*(const int *)b].result.crossings_per_hour;
+    return (x > y) - (x < y);
+}
+
+// Unstable runs and runs that completed no vehicle have no meaningful objectives
+int unscored(const Result *r) {
+    return r->score >= 2e9;
+}
+
+void print_front() {
+    static int final[MAX_CANDIDATES], front[MAX_CANDIDATES];
+    int n = finalists(final), f = 0;
+    for (int i = 0; i < n; ++i) {
+        Result *r = &candidates[final[i]].result;
+        if (unscored(r))
+            continue;
+        int dominated = 0;
+        for (int j = 0; j < n && !dominated; ++j) {
+            if (j != i && !unscored(&candidates[final[j]].result) && dominates(&candidates[final[j]].result, r))
+                dominated = 1;
+        }
+        if (!dominated)
+            front[f++] = final[i];
+    }
+    qsort(front, f, sizeof(int), compare_by_crossings);
+
+    printf("\n=== Pareto front (%s system time vs. crossings/hour, %d of %d finalists) ===\n",
+           use_p95 ? "p95" : "mean", f, n);
+    printf("gates square capacity ramps timeout  car%%  bus%% truck%%   p95(s)  mean(s)  veh/h  cross/h\n");
+    for (int i = 0; i < f; ++i) {
+        Candidate *c = &candidates[front[i]];
+        printf("%5d %6d %8d %5d %7.1f %5.0f %5.0f %6.0f %8.1f %8.1f %6.0f %8.1f%s\n",
+               c->params.gates, c->params.square, c->params.capacity, c->params.ramps, c->params.timeout,
+               c->params.mix[0] * 100, c->params.mix[1] * 100, c->params.mix[2] * 100,
+               c->result.p95, c->result.mean, c->result.throughput, c->result.crossings_per_hour,
+               max_crossings > 0 && c->result.crossings_per_hour > max_crossings ? "  (over limit)" : "");
+    }
+    if (n > 0 && candidates[final[0]].result.score < 1e9) {
+        Candidate *best = &candidates[final[0]];
+        printf("\nBest feasible: gates %d, square %d, capacity %d, ramps %d, timeout %.1fs -> %s %.1fs at %.1f crossings/h\n",
+               best->params.gates, best->params.square, best->params.capacity, best->params.ramps, best->params.timeout,
+               use_p95 ? "p95" : "mean", best->result.score, best->result.crossings_per_hour);
+    } else {
+        printf("\nNo configuration met the constraints.\n");
+    }
+
+    if (csv_path != NULL) {
+        FILE *out = fopen(csv_path, "w");
+        if (out == NULL) {
+            perror("fopen csv failed");
+            return;
+        }
+        fprintf(out, "gates,square,capacity,ramps,timeout,car,minibus,truck,p95,mean,throughput,crossings_per_hour,pareto\n");
+        for (int i = 0; i < n; ++i) {
+            Candidate *c = &candidates[final[i]];
+            int on_front = 0;
+            for (int j = 0; j < f; ++j) {
+                on_front |= front[j] == final[i];
+            }
+            fprintf(out, "%d,%d,%d,%d,%.2f,%.4f,%.4f,%.4f,%.2f,%.2f,%.1f,%.2f,%d\n",
+                    c->params.gates, c->params.square, c->params.capacity, c->params.ramps, c->params.timeout,
+                    c->params.mix[0], c->params.mix[1], c->params.mix[2],
+                    c->result.p95, c->result.mean, c->result.throughput, c->result.crossings_per_hour, on_front);
+        }
+        fclose(out);
+    }
+}
+
+void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  --rate R            Mean arrivals per second (default %.2f)\n"
+            "  --objective O       p95 or mean system time (default p95)\n"
+            "  --max-crossings K   At most K crossings per hour (default unconstrained)\n"
+            "  --hours H           Full simulated budget per finalist (default %.1f)\n"
+            "  --min-hours H       Budget of the first halving round (default %.1f)\n"
+            "  --warmup S          Simulated warm-up seconds discarded (default %.0f)\n"
+            "  --brackets B        Successive-halving brackets (default %d)\n"
+            "  --candidates N      Candidates per bracket, at most %d total (default %d)\n"
+            "  --jobs J            Parallel simulation instances (default: CPU count)\n"
+            "  --seed S            Random seed (default %u)\n"
+            "  --tune-mix          Also search the fleet mix\n"
+            "  --csv FILE          Write all finalists with a Pareto flag\n"
+            "  --lanes LIST        Lane kinds in gate order, mixed/tag/heavy; the first must\n"
+            "                      be mixed, lanes past the list are mixed (default all mixed)\n"
+            "  --tag-share F       Fraction of vehicles with a pre-paid tag (default %.2f)\n",
+            prog, arrival_rate, max_hours, min_hours, warmup, brackets, MAX_CANDIDATES,
+            bracket_size, base_seed, tag_share);
+}
+
+int parse_lanes(const char *spec) {
+    char buf[64];
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (n == MAX_GATES) {
+            fprintf(stderr, "At most %d toll lanes per side\n", MAX_GATES);
+            return -1;
+        }
+        if (strcmp(tok, "mixed") == 0) lane_layout[n++] = LANE_MIXED;
+        else if (strcmp(tok, "tag") == 0) lane_layout[n++] = LANE_TAG;
+        else if (strcmp(tok, "heavy") == 0) lane_layout[n++] = LANE_HEAVY;
+        else {
+            fprintf(stderr, "Unknown lane kind: %s\n", tok);
+            return -1;
+        }
+    }
+    // Candidates may use a single gate, and cash-paying cars need a mixed lane
+    if (n == 0 || lane_layout[0] != LANE_MIXED) {
+        fprintf(stderr, "The first toll lane must be mixed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--tune-mix") == 0) {
+            tune_mix = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char *value = argv[++i];
+        if (strcmp(opt, "--rate") == 0) arrival_rate = atof(value);
+        else if (strcmp(opt, "--objective") == 0) use_p95 = strcmp(value, "mean") != 0;
+        else if (strcmp(opt, "--max-crossings") == 0) max_crossings = atof(value);
+        else if (strcmp(opt, "--hours") == 0) max_hours = atof(value);
+        else if (strcmp(opt, "--min-hours") == 0) min_hours = atof(value);
+        else if (strcmp(opt, "--warmup") == 0) warmup = atof(value);
+        else if (strcmp(opt, "--brackets") == 0) brackets = atoi(value);
+        else if (strcmp(opt, "--candidates") == 0) bracket_size = atoi(value);
+        else if (strcmp(opt, "--jobs") == 0) jobs = atoi(value);
+        else if (strcmp(opt, "--seed") == 0) base_seed = (unsigned int)atoi(value);
+        else if (strcmp(opt, "--csv") == 0) csv_path = value;
+        else if (strcmp(opt, "--tag-share") == 0) tag_share = atof(value);
+        else if (strcmp(opt, "--lanes") == 0) {
+            if (parse_lanes(value) != 0)
+                return EXIT_FAILURE;
+        }
+        else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > 256)
+        jobs = 256;
+    if (arrival_rate <= 0 || min_hours <= 0 || max_hours < min_hours || brackets <= 0 ||
+        bracket_size <= 0 || bracket_size > MAX_CANDIDATES || tag_share < 0 || tag_share > 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("Tuning for %.2f arrivals/s: minimize %s system time", arrival_rate, use_p95 ? "p95" : "mean");
+    if (max_crossings > 0)
+        printf(" with at most %.1f crossings/hour", max_crossings);
+    printf(" (%d brackets x %d candidates, %d jobs)\n", brackets, bracket_size, jobs);
+
+    unsigned int seed = base_seed;
+    for (int b = 0; b < brackets; ++b) {
+        run_bracket(b, &seed);
+    }
+    print_front();
+    return 0;
+}